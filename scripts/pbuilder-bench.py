@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+
+# End-to-end benchmark of pbuilder without Buildroot. It generates a layered dependencies file and
+# a spec of each package (time, output and exit code), puts pbuilder-mock-make.py first on PATH as
+# 'make' and runs the real pbuilder binary against them. Then it compares the build with the ideal
+# one, simulated by 'pbuilder --simulate' with the times measured by the fake make, and shows the
+# overhead of pbuilder, the idle slot time caused by the scheduler and the throughput of the logs.
+# The arguments after '--' are passed to pbuilder.
+
+import argparse
+import math
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+LAYERS = 10
+SPLIT_STEPS = 5
+MAX_PARENTS = 4
+
+def generate(work, args):
+    rng = random.Random(args.seed)
+    width = max(args.packages // LAYERS, 1)
+    parents = {}
+    failed = set(rng.sample(range(1, args.packages), min(args.failures, args.packages - 1)))
+
+    with open(os.path.join(work, "bench.deps"), "w") as deps, \
+            open(os.path.join(work, "bench.spec"), "w") as spec, \
+            open(os.path.join(work, "pbuilder_history"), "w") as history:
+        for i in range(args.packages):
+            name = "pkg%d" % i
+            level = min(i // width, LAYERS - 1)
+            parents[name] = []
+            if i > 0:
+                parents[name].append("pkg0")
+            if level > 0:
+                first = max(level - 3, 0) * width
+                for _ in range(rng.randint(1, MAX_PARENTS)):
+                    parents[name].append("pkg%d" % rng.randrange(first, level * width))
+            parents[name] = sorted(set(parents[name]))
+
+            secs = rng.lognormvariate(math.log(args.median), args.sigma)
+            nbytes = int(rng.lognormvariate(math.log(args.output * 1024), 1.0))
+
+            deps.write("%s: 1.0: %s\n" % (name, " ".join(parents[name])))
+            spec.write("%s %.3f %d %d\n" % (name, secs, nbytes, 2 if i in failed else 0))
+            # The scheduler knows the times from the history, as after a previous build
+            history.write("%s 1.0 %.3f 0 %d 0 -\n" % (name, secs, int(time.time())))
+
+    return parents
+
+
+def read_events(path):
+    events = {}
+
+    if not os.path.exists(path):
+        return events
+
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) == 5:
+                events[fields[0]] = (float(fields[1]), float(fields[2]), int(fields[3]), int(fields[4]))
+
+    return events
+
+
+def scheduler_idle(events, parents, slots):
+    # A package is ready when all its parents are done and it waits for the scheduler while a slot is free
+    origin = min(e[0] for e in events.values())
+    changes = []
+    latency = []
+
+    for name, (start, end, _, _) in events.items():
+        ready = max([events[p][1] for p in parents[name] if p in events] + [origin])
+        ready = min(ready, start)
+        latency.append((start - ready, name))
+        changes += [(ready, 0, 1), (start, 0, -1), (start, 1, 1), (end, 1, -1)]
+
+    changes.sort()
+    waiting = running = 0
+    idle = 0.0
+    last = origin
+
+    for t, kind, delta in changes:
+        idle += min(max(slots - running, 0), waiting) * (t - last)
+        last = t
+        if kind == 0:
+            waiting += delta
+        else:
+            running += delta
+
+    return idle, latency
+
+
+def mock_startup(mock, env, runs=5):
+    # Time from the start of the fake make until it can record its start, which counts as overhead
+    start = time.monotonic()
+    for _ in range(runs):
+        subprocess.call([mock], env=env, stdout=subprocess.DEVNULL)
+
+    return (time.monotonic() - start) / runs
+
+
+def dir_size(path):
+    total = 0
+
+    for root, _, files in os.walk(path):
+        for f in files:
+            total += os.path.getsize(os.path.join(root, f))
+
+    return total
+
+
+def strip_colors(text):
+    return re.sub(r"\x1b\[[0-9;]*m", "", text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="End-to-end benchmark of pbuilder with a fake make")
+    parser.add_argument("-b", "--pbuilder", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "pbuilder"),
+        help="pbuilder binary. Default: ../src/pbuilder")
+    parser.add_argument("-n", "--packages", type=int, default=200, help="Number of packages. Default: 200")
+    parser.add_argument("-c", "--cpu", type=int, default=os.cpu_count(), help="Number of slots. Default: number of CPUs")
+    parser.add_argument("-s", "--schedule", default="priority", help="Scheduling policy. Default: priority")
+    parser.add_argument("-m", "--median", type=float, default=0.5, help="Median time of a package in secs. Default: 0.5")
+    parser.add_argument("--sigma", type=float, default=1.0, help="Sigma of the log-normal times. Default: 1.0")
+    parser.add_argument("-o", "--output", type=int, default=64, help="Median output of a package in KB. Default: 64")
+    parser.add_argument("-f", "--failures", type=int, default=0, help="Number of packages that fail. Default: 0")
+    parser.add_argument("--seed", type=int, default=1, help="Seed of the generated graph. Default: 1")
+    parser.add_argument("-k", "--keep", action="store_true", help="Keep the work directory")
+    parser.add_argument("extra", nargs="*", help="Arguments passed to pbuilder after '--'")
+    args = parser.parse_args()
+
+    pbuilder = os.path.abspath(args.pbuilder)
+    if not os.access(pbuilder, os.X_OK):
+        print("pbuilder binary not found: %s" % pbuilder)
+        return 1
+
+    # pbuilder doesn't use more slots than CPUs when it builds
+    slots = max(min(args.cpu, os.cpu_count()), 1)
+    split = "-S" in args.extra or "--split-steps" in args.extra
+
+    work = tempfile.mkdtemp(prefix="pbuilder-bench-")
+    os.mkdir(os.path.join(work, "bin"))
+    os.mkdir(os.path.join(work, "build"))
+    os.symlink(os.path.join(os.path.dirname(os.path.abspath(__file__)), "pbuilder-mock-make.py"),
+        os.path.join(work, "bin", "make"))
+
+    parents = generate(work, args)
+
+    env = dict(os.environ)
+    env["PATH"] = os.path.join(work, "bin") + os.pathsep + env.get("PATH", "")
+    env["BUILD_DIR"] = os.path.join(work, "build")
+    env["CONFIG_DIR"] = work
+    env["BR2_EXTERNAL"] = ""
+    env["PBUILDER_MOCK_SPEC"] = os.path.join(work, "bench.spec")
+    env["PBUILDER_MOCK_EVENTS"] = os.path.join(work, "bench.events")
+
+    cmd = [pbuilder, "-f", os.path.join(work, "bench.deps"), "-c", str(slots), "-s", args.schedule]
+    print("Running: %s" % " ".join(cmd + args.extra))
+
+    with open(os.path.join(work, "pbuilder.out"), "w") as out:
+        start = time.monotonic()
+        rc = subprocess.call(cmd + args.extra, cwd=work, env=env, stdout=out, stderr=subprocess.STDOUT)
+        wall = time.monotonic() - start
+
+    events = read_events(env["PBUILDER_MOCK_EVENTS"])
+    targets = {t: e for t, e in events.items() if (t.rsplit("-", 1)[0] if split else t) in parents}
+
+    if not targets:
+        print("pbuilder exited with %d without building anything, see %s" % (rc, os.path.join(work, "pbuilder.out")))
+        return 1
+
+    # The ideal build of the same graph and policy with the measured times and no overhead
+    with open(os.path.join(work, "bench.times"), "w") as f:
+        for t, e in targets.items():
+            f.write("%s %.6f\n" % (t, e[1] - e[0]))
+
+    sim = subprocess.run(cmd + [a for a in args.extra if a in ("-S", "--split-steps")] +
+        ["-n", os.path.join(work, "bench.times")],
+        cwd=work, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    match = re.search(r"Simulated makespan: ([0-9.]+) secs", strip_colors(sim.stdout))
+    ideal = float(match.group(1)) if match else None
+
+    startup = mock_startup(os.path.join(work, "bin", "make"), dict(env, PBUILDER_MOCK_EVENTS=""))
+
+    first = min(e[0] for e in targets.values())
+    last = max(e[1] for e in targets.values())
+    span = last - first
+    work_secs = sum(e[1] - e[0] for e in targets.values())
+    emitted = sum(e[3] for e in targets.values())
+    logged = dir_size(os.path.join(work, "pbuilder_logs"))
+    failed = sorted(t for t, e in targets.items() if e[2] != 0)
+    nodes = len(parents) * (SPLIT_STEPS if split else 1)
+
+    print("")
+    print("pbuilder exit status:     %d" % rc)
+    print("Nodes built:              %d of %d, %d failed" % (len(targets) - len(failed), nodes, len(failed)))
+    print("Slots:                    %d" % slots)
+    print("Wall time:                %.3f secs (%.3f secs before the first build, %.3f secs after the last one)" %
+        (wall, first - start, start + wall - last))
+    print("Build span:               %.3f secs" % span)
+    if len(targets) != nodes or failed:
+        print("Ideal makespan:           not comparable, some nodes were not built")
+    elif ideal is not None:
+        print("Ideal makespan:           %.3f secs" % ideal)
+        print("Overhead:                 %.3f secs (%.1f%%)" % (span - ideal, 100.0 * (span - ideal) / ideal if ideal > 0 else 0.0))
+        print("Fake make startup:        %.3f ms per package, included in the overhead" % (1000.0 * startup))
+    else:
+        print("Ideal makespan:           unknown, the simulation failed")
+    print("Slot utilization:         %.1f%%" % (100.0 * work_secs / (slots * span) if span > 0 else 0.0))
+    if not split:
+        idle, latency = scheduler_idle(targets, parents, slots)
+        latency.sort(reverse=True)
+        print("Scheduler idle time:      %.3f slot-secs with ready packages and free slots" % idle)
+        print("Wait of ready packages:   avg %.3f ms, max %.3f ms (%s)" %
+            (1000.0 * sum(l for l, _ in latency) / len(latency), 1000.0 * latency[0][0], latency[0][1]))
+    print("Log throughput:           %.1f MB emitted, %.1f MB written to pbuilder_logs, %.1f MB/s" %
+        (emitted / 1e6, logged / 1e6, emitted / 1e6 / span if span > 0 else 0.0))
+
+    if args.keep:
+        print("Work directory:           %s" % work)
+    else:
+        shutil.rmtree(work)
+
+    return rc
+
+
+if __name__ == "__main__":
+    sys.exit(main())
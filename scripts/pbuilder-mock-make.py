@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+
+# Fake 'make' used by pbuilder-bench.py for measuring pbuilder without Buildroot.
+# It emulates the build of the package given as target according to a spec file, where each line is:
+#
+#   <package> <secs> <output bytes> <exit code> [<steps>]
+#
+# and <steps> is a comma-separated list of the Buildroot steps whose '>>>' lines are printed
+# (extract, patch, configure, build, install), all of them by default or none if it's '-'.
+# The time and the output of the package are split among its steps. A target '<package>-<step>',
+# as built with 'pbuilder -S', only emulates that step. The '<package>-source' targets and the
+# targets that are not in the spec, like target-post-image, succeed right away.
+# When each target is done, a line '<target> <start> <end> <exit code> <output bytes>' with the
+# monotonic times is appended to the events file.
+#
+# The spec and events files are given in the PBUILDER_MOCK_SPEC and PBUILDER_MOCK_EVENTS env variables.
+
+import os
+import sys
+import time
+
+STEPS = [
+    ("extract", "Extracting", 0.10),
+    ("patch", "Patching", 0.05),
+    ("configure", "Configuring", 0.20),
+    ("build", "Building", 0.55),
+    ("install", "Installing to target", 0.10),
+]
+
+LINE_LEN = 100
+
+
+def read_spec(path, package):
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith("#") or fields[0] != package:
+                continue
+            steps = [s[0] for s in STEPS]
+            if len(fields) > 4:
+                steps = [] if fields[4] == "-" else fields[4].split(",")
+            return float(fields[1]), int(fields[2]), int(fields[3]), steps
+
+    return None
+
+
+def write_output(out, nbytes):
+    line = b"x" * (LINE_LEN - 1) + b"\n"
+
+    while nbytes >= LINE_LEN:
+        out.write(line)
+        nbytes -= LINE_LEN
+    if nbytes > 0:
+        out.write(b"x" * (nbytes - 1) + b"\n")
+
+
+def emulate(package, version, secs, nbytes, steps, only_step):
+    out = sys.stdout.buffer
+    deadline = time.monotonic()
+    written = 0
+
+    for name, marker, share in STEPS:
+        if only_step is not None and name != only_step:
+            continue
+        if only_step is not None:
+            share = 1.0
+
+        if name in steps:
+            out.write(("\033[7m>>> %s %s %s\033[27m\n" % (package, version, marker)).encode())
+
+        step_bytes = int(nbytes * share)
+        write_output(out, step_bytes)
+        written += step_bytes
+        out.flush()
+
+        deadline += secs * share
+        remaining = deadline - time.monotonic()
+        if remaining > 0:
+            time.sleep(remaining)
+
+    return written
+
+
+def main():
+    start = time.monotonic()
+    target = sys.argv[1] if len(sys.argv) > 1 else ""
+    spec_path = os.environ.get("PBUILDER_MOCK_SPEC")
+    events_path = os.environ.get("PBUILDER_MOCK_EVENTS")
+    exit_code = 0
+    written = 0
+
+    package, only_step = target, None
+    spec = read_spec(spec_path, package) if spec_path else None
+
+    if spec is None and "-" in target:
+        package, step = target.rsplit("-", 1)
+        if step in [s[0] for s in STEPS]:
+            spec = read_spec(spec_path, package) if spec_path else None
+            only_step = step
+
+    if spec is not None:
+        secs, nbytes, exit_code, steps = spec
+        written = emulate(package, "1.0", secs, nbytes, steps, only_step)
+        # A failed package fails in its build step
+        if only_step is not None and only_step != "build":
+            exit_code = 0
+        if exit_code != 0:
+            sys.stdout.write("make: *** [package/pkg-generic.mk] Error %d\n" % exit_code)
+            sys.stdout.flush()
+
+    if events_path:
+        record = "%s %.6f %.6f %d %d\n" % (target, start, time.monotonic(), exit_code, written)
+        fd = os.open(events_path, os.O_WRONLY | os.O_APPEND | os.O_CREAT, 0o644)
+        os.write(fd, record.encode())
+        os.close(fd)
+
+    return exit_code
+
+
+if __name__ == "__main__":
+    sys.exit(main())
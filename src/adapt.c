@@ -0,0 +1,144 @@
+/**
+ * @file adapt.c
+ * @brief Controller that raises or lowers the number of packages built at the same time
+ * between a min and a max according to the pressure stall information (PSI) and the load
+ * average of the system, so a shared build host is neither overloaded nor idle.
+ * A slot is removed as soon as any resource is under pressure and added back only when
+ * all of them are relaxed and all the current slots are in use.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "adapt.h"
+
+/**
+ * @brief Parse the range of slots given in the cmdline
+ * @param pg Main struct. cpu_num must be already set and is used as the default max
+ * @param range String with the format MIN:MAX or MIN
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_adapt_parse_range(PBMain pg, const gchar *range)
+{
+    guint   min,
+            max;
+    gint    n;
+
+    if (!pg || !range)
+        return PB_FAIL;
+
+    max = pg->cpu_num;
+    n = sscanf(range, "%u:%u", &min, &max);
+    if (n < 1 || min < 1 || max < min || max > pg->cpu_num) {
+        pb_log(PB_ERR, "%s(): Invalid range of slots '%s'. Expected MIN:MAX with 1 <= MIN <= MAX <= %u\n",
+            __func__, range, pg->cpu_num);
+        return PB_FAIL;
+    }
+
+    pg->adaptive = TRUE;
+    pg->slots_min = min;
+    pg->slots_max = max;
+    pg->slots = max;
+
+    return PB_OK;
+}
+
+/**
+ * @brief Read the "some avg10" value of a PSI file
+ * @param path The PSI file
+ * @return The percentage or a negative value if it can't be read
+ */
+static gdouble pb_adapt_read_psi(const gchar *path)
+{
+    gchar   line[BUFF_1K];
+    gdouble avg10 = -1;
+    FILE    *fd;
+
+    if ((fd = fopen(path, "r")) == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), fd))
+        if (sscanf(line, "some avg10=%lf", &avg10) == 1)
+            break;
+
+    fclose(fd);
+
+    return avg10;
+}
+
+/**
+ * @brief Read the load average of the last minute divided by the number of online CPUs
+ * @return The load or a negative value if it can't be read
+ */
+static gdouble pb_adapt_read_load(void)
+{
+    gdouble load = -1;
+    FILE    *fd;
+
+    if ((fd = fopen(PB_ADAPT_LOADAVG, "r")) == NULL)
+        return -1;
+
+    if (fscanf(fd, "%lf", &load) != 1)
+        load = -1;
+
+    fclose(fd);
+
+    return (load < 0) ? -1 : load / g_get_num_processors();
+}
+
+/**
+ * @brief Sample the system pressure and adjust the number of slots if needed.
+ * Does nothing if the controller is disabled or if the last sample is too recent.
+ * @param pg Main struct
+ */
+void pb_adapt_update(PBMain pg)
+{
+    PBAdaptSample   s;
+    gboolean        high,
+                    low;
+    guint           slots,
+                    max;
+    gint64          now;
+
+    if (!pg->adaptive)
+        return;
+
+    now = g_get_monotonic_time();
+    if (now < pg->adapt_next_usecs)
+        return;
+
+    pg->adapt_next_usecs = now + PB_ADAPT_INTERVAL_USECS;
+
+    s.cpu = pb_adapt_read_psi(PB_ADAPT_PSI_CPU);
+    s.memory = pb_adapt_read_psi(PB_ADAPT_PSI_MEMORY);
+    s.io = pb_adapt_read_psi(PB_ADAPT_PSI_IO);
+    s.load = pb_adapt_read_load();
+
+    /* Values that can't be read (e.g. kernels without PSI) don't count */
+    high = s.cpu > PB_ADAPT_CPU_HIGH || s.memory > PB_ADAPT_MEMORY_HIGH ||
+        s.io > PB_ADAPT_IO_HIGH || s.load > PB_ADAPT_LOAD_HIGH;
+    low = s.cpu < PB_ADAPT_CPU_LOW && s.memory < PB_ADAPT_MEMORY_LOW &&
+        s.io < PB_ADAPT_IO_LOW && s.load < PB_ADAPT_LOAD_LOW;
+
+    pb_debug(2, DBG_EXEC, "Pressure: cpu %.2f%%, memory %.2f%%, io %.2f%%, load %.2f per CPU\n",
+        s.cpu, s.memory, s.io, s.load);
+
+    /* The slots removed after a build was killed by the OOM killer are never added back */
+    max = pg->slots_oom_max ? MIN(pg->slots_max, pg->slots_oom_max) : pg->slots_max;
+
+    slots = pg->slots;
+    if (high && slots > pg->slots_min)
+        slots--;
+    else if (!high && low && slots < max && pg->nodes_running >= slots)
+        slots++;
+
+    if (slots == pg->slots)
+        return;
+
+    pb_log(PB_INFO, "===== Concurrency %u -> %u (cpu %.2f%%, memory %.2f%%, io %.2f%%, load %.2f per CPU)\n",
+        pg->slots, slots, s.cpu, s.memory, s.io, s.load);
+
+    pg->slots = slots;
+    pg->slots_changes++;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file adapt.h
+ * @brief Adaptive number of packages built at the same time
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _ADAPT_H_
+#define _ADAPT_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+#define PB_ADAPT_PSI_CPU            "/proc/pressure/cpu"
+#define PB_ADAPT_PSI_MEMORY         "/proc/pressure/memory"
+#define PB_ADAPT_PSI_IO             "/proc/pressure/io"
+#define PB_ADAPT_LOADAVG            "/proc/loadavg"
+
+/**
+ * Time between two samples of the system pressure
+ */
+#define PB_ADAPT_INTERVAL_USECS     (5 * G_USEC_PER_SEC)
+
+/**
+ * Pressure (percentage of time some task stalled in the last 10 secs) above which
+ * a slot is removed and below which a slot can be added
+ */
+#define PB_ADAPT_CPU_HIGH           80.0
+#define PB_ADAPT_CPU_LOW            40.0
+#define PB_ADAPT_MEMORY_HIGH        10.0
+#define PB_ADAPT_MEMORY_LOW         2.0
+#define PB_ADAPT_IO_HIGH            50.0
+#define PB_ADAPT_IO_LOW             20.0
+
+/**
+ * Load average per online CPU above which a slot is removed and below which a slot can be added
+ */
+#define PB_ADAPT_LOAD_HIGH          2.0
+#define PB_ADAPT_LOAD_LOW           1.0
+
+/**
+ * A sample of the system pressure. Negative values mean that it couldn't be read
+ */
+typedef struct pbuilder_adapt_sample_st
+{
+    gdouble         cpu;                /**< CPU pressure: some avg10 */
+    gdouble         memory;             /**< Memory pressure: some avg10 */
+    gdouble         io;                 /**< I/O pressure: some avg10 */
+    gdouble         load;               /**< Load average of the last minute per online CPU */
+} PBAdaptSample;
+
+PBResult    pb_adapt_parse_range(PBMain, const gchar *);
+void        pb_adapt_update(PBMain);
+
+#endif  /* _ADAPT_H_ */
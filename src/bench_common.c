@@ -0,0 +1,217 @@
+/**
+ * @file bench_common.c
+ * @brief Synthetic dependencies files and main struct shared by the benchmarks, so all of them
+ * measure the same graphs created the same way as pbuilder does.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "bench_common.h"
+
+const gchar * const pb_bench_shapes[PB_BENCH_SHAPES_NUM] = { "layered", "wide", "chain", "meta" };
+
+/**
+ * @brief Find a shape by its name
+ * @param name The name
+ * @return The shape or -1 if there's no shape with that name
+ */
+gint pb_bench_find_shape(const gchar *name)
+{
+    gint    s;
+
+    for (s = 0; s < PB_BENCH_SHAPES_NUM; s++)
+        if (!g_strcmp0(pb_bench_shapes[s], name))
+            return s;
+
+    return -1;
+}
+
+/**
+ * @brief Add to the dependencies file the parents of a package according to the shape of the graph.
+ * The parents are always previous packages, so the graph is acyclic.
+ * - layered: the packages are split in PB_BENCH_LAYERS levels and each one depends on the first one,
+ *   like on the toolchain, and on up to PB_BENCH_MAX_PARENTS packages of the previous three levels.
+ * - wide: a chain of PB_BENCH_HUBS packages on which all the other ones depend, so each
+ *   package becomes ready when the first ones are built and the fan-out is huge.
+ * - chain: each package depends on the previous one and sometimes on another one, so the depth
+ *   of the graph is the number of packages.
+ * - meta: each package depends on up to PB_BENCH_META_MAX_PARENTS random packages and every
+ *   PB_BENCH_META_EVERY packages there's a meta-package that depends on all the previous ones.
+ * @param contents The dependencies file
+ * @param rand Random numbers generator
+ * @param shape The shape
+ * @param i The package
+ * @param packages Number of packages
+ * @return Number of parents
+ */
+static guint pb_bench_add_parents(GString *contents, GRand *rand, PBBenchShape shape, guint i, guint packages)
+{
+    guint   width = MAX(packages / PB_BENCH_LAYERS, 1),
+            level,
+            first,
+            n = 0,
+            j;
+
+    if (i == 0)
+        return 0;
+
+    switch (shape) {
+        case PB_BENCH_LAYERED:
+            level = MIN(i / width, PB_BENCH_LAYERS - 1);
+            g_string_append(contents, " pkg0");
+            n++;
+            if (level > 0) {
+                first = (level > 3 ? level - 3 : 0) * width;
+                for (j = g_rand_int_range(rand, 1, PB_BENCH_MAX_PARENTS + 1); j > 0; j--, n++)
+                    g_string_append_printf(contents, " pkg%u", g_rand_int_range(rand, first, level * width));
+            }
+            break;
+        case PB_BENCH_WIDE:
+            if (i < PB_BENCH_HUBS) {
+                g_string_append_printf(contents, " pkg%u", i - 1);
+                n++;
+            }
+            else {
+                for (j = g_rand_int_range(rand, 1, 4); j > 0; j--, n++)
+                    g_string_append_printf(contents, " pkg%u", g_rand_int_range(rand, 0, PB_BENCH_HUBS));
+            }
+            break;
+        case PB_BENCH_META:
+            if (i % PB_BENCH_META_EVERY == 0) {
+                for (j = i - PB_BENCH_META_EVERY; j < i; j++, n++)
+                    g_string_append_printf(contents, " pkg%u", j);
+            }
+            else {
+                for (j = g_rand_int_range(rand, 0, MIN(i, PB_BENCH_META_MAX_PARENTS) + 1); j > 0; j--, n++)
+                    g_string_append_printf(contents, " pkg%u", g_rand_int_range(rand, 0, i));
+            }
+            break;
+        case PB_BENCH_CHAIN:
+        default:
+            g_string_append_printf(contents, " pkg%u", i - 1);
+            n++;
+            if (g_rand_int_range(rand, 0, 4) == 0) {
+                g_string_append_printf(contents, " pkg%u", g_rand_int_range(rand, 0, i));
+                n++;
+            }
+            break;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Write a synthetic dependencies file. Every tenth package has no version, like the virtual
+ * packages. The seed is fixed, so every run uses the same file.
+ * @param path The file
+ * @param shape The shape of the graph
+ * @param packages Number of packages
+ * @param deps Where the size of the file is stored
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_bench_write_deps(const gchar *path, PBBenchShape shape, guint packages, PBBenchDeps deps)
+{
+    GString     *contents;
+    GRand       *rand;
+    GError      *error = NULL;
+    gsize       line_start;
+    guint       i;
+
+    contents = g_string_new(NULL);
+    g_string_printf(contents, "# Synthetic dependencies file: %s graph of %u packages\n", pb_bench_shapes[shape], packages);
+    rand = g_rand_new_with_seed(1);
+    memset(deps, 0, sizeof(*deps));
+
+    for (i = 0; i < packages; i++) {
+        line_start = contents->len;
+
+        if (i % 10 == 0)
+            g_string_append_printf(contents, "pkg%u: :", i);
+        else
+            g_string_append_printf(contents, "pkg%u: %u.%u:", i, g_rand_int_range(rand, 0, 10), i % 100);
+
+        deps->edges += pb_bench_add_parents(contents, rand, shape, i, packages);
+        deps->longest = MAX(deps->longest, contents->len - line_start);
+        g_string_append_c(contents, '\n');
+    }
+
+    g_rand_free(rand);
+
+    deps->size = contents->len;
+
+    if (!g_file_set_contents(path, contents->str, contents->len, &error)) {
+        pb_log(PB_ERR, "%s(): Failed to write %s: %s\n", __func__, path, error->message);
+        g_error_free(error);
+        g_string_free(contents, TRUE);
+        return PB_FAIL;
+    }
+
+    g_string_free(contents, TRUE);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Create the temporary directory used as the build and config directories, with the
+ * dependencies file given in deps_file and the graph cache inside it
+ * @param env Where the environment is stored
+ * @return The path of the graph cache, to be freed by pb_bench_cleanup(), or NULL if it failed
+ */
+gchar * pb_bench_init(PBEnv env)
+{
+    gchar   *dir;
+
+    if ((dir = g_dir_make_tmp("pbuilder-bench-XXXXXX", NULL)) == NULL) {
+        pb_log(PB_ERR, "Failed to create a temporary directory\n");
+        return NULL;
+    }
+
+    env->build_dir = env->config_dir = dir;
+    env->br2_external = "";
+
+    deps_file = g_strdup_printf("%s/bench.deps", dir);
+
+    return g_strdup_printf("%s/%s", dir, PB_GRAPH_CACHE_FILE);
+}
+
+/**
+ * @brief Remove the temporary directory created by pb_bench_init() and its files
+ * @param env The environment
+ * @param cache The path of the graph cache
+ */
+void pb_bench_cleanup(PBEnv env, gchar *cache)
+{
+    unlink(cache);
+    unlink(deps_file);
+    rmdir(env->config_dir);
+
+    g_free(cache);
+    g_free(deps_file);
+    g_free(env->config_dir);
+    deps_file = NULL;
+}
+
+/**
+ * @brief Create a main struct like the one of pbuilder, without any of the resources used
+ * while building, so the graph can be created and freed as pbuilder does
+ * @param env The environment, pointing to the temporary directory
+ * @param slots Number of slots
+ * @param policy Name of the scheduling policy or NULL for the default one
+ * @return The main struct, freed by pb_graph_free()
+ */
+PBMain pb_bench_new_main(PBEnv env, guint slots, const gchar *policy)
+{
+    PBMain  pg;
+
+    pg = g_new0(struct pbuilder_main_st, 1);
+    pg->jobserver_fds[0] = pg->jobserver_fds[1] = pg->jobserver_rd = -1;
+    pg->epoll_fd = -1;
+    pg->log_compressor = -1;
+    pg->cpu_num = pg->slots = slots;
+    pg->policy = pb_sched_find(policy ? policy : SCHED_DEFAULT);
+    pg->env = env;
+
+    return pg;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file bench_common.h
+ * @brief Synthetic dependencies files and main struct shared by the benchmarks
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include "graph_create.h"
+#include "utils.h"
+
+/**
+ * Number of levels of the layered graphs, close to the depth of a big Buildroot configuration
+ */
+#define PB_BENCH_LAYERS             20
+
+/**
+ * Number of packages of the wide graphs on which all the other ones depend, like the toolchain
+ */
+#define PB_BENCH_HUBS               8
+
+/**
+ * Max number of parents of a package of the layered graphs
+ */
+#define PB_BENCH_MAX_PARENTS        6
+
+/**
+ * Max number of parents of a regular package of the meta graphs and number of packages
+ * between two meta-packages, whose lines are much longer than 4 KB
+ */
+#define PB_BENCH_META_MAX_PARENTS   8
+#define PB_BENCH_META_EVERY         1000
+
+typedef enum
+{
+    PB_BENCH_LAYERED,
+    PB_BENCH_WIDE,
+    PB_BENCH_CHAIN,
+    PB_BENCH_META,
+    PB_BENCH_SHAPES_NUM
+} PBBenchShape;
+
+typedef struct pbuilder_bench_deps_st *     PBBenchDeps;
+
+/**
+ * Size of a synthetic dependencies file
+ */
+struct pbuilder_bench_deps_st
+{
+    guint           edges;              /**< Number of dependencies */
+    guint           longest;            /**< Length of the longest line */
+    gsize           size;               /**< Size of the file in bytes */
+};
+
+extern const gchar * const pb_bench_shapes[PB_BENCH_SHAPES_NUM];
+
+gint        pb_bench_find_shape(const gchar *);
+PBResult    pb_bench_write_deps(const gchar *, PBBenchShape, guint, PBBenchDeps);
+gchar *     pb_bench_init(PBEnv);
+void        pb_bench_cleanup(PBEnv, gchar *);
+PBMain      pb_bench_new_main(PBEnv, guint, const gchar *);
+
+#endif  /* _BENCH_COMMON_H_ */
@@ -0,0 +1,145 @@
+/**
+ * @file bench_deps.c
+ * @brief Benchmark of the creation of the graph from a dependencies file.
+ * It writes a synthetic dependencies file of the meta shape, 20000 packages by default, where every
+ * PB_BENCH_META_EVERY packages there's a meta-package that depends on all the previous ones,
+ * so its line is much longer than 4 KB. Then it measures the time required to parse it, calculate
+ * the priorities and sort the nodes, and the time required to load the graph from the graph cache.
+ * Usage: bench_deps [packages] [iterations]
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "bench_common.h"
+
+#define PB_BENCH_PACKAGES           20000
+#define PB_BENCH_ITERATIONS         10
+
+/**
+ * @brief Parse the dependencies file, calculate the priorities and sort the nodes, as pbuilder does
+ * when the graph cache can't be used. Only these steps are timed. Then the graph cache is written,
+ * so it can be loaded by pb_bench_load_cache().
+ * @param env The environment, pointing to the temporary directory
+ * @param usecs Where the elapsed time is stored
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_bench_parse(PBEnv env, gint64 *usecs)
+{
+    guint8      key[PB_GRAPH_CACHE_KEY_LEN];
+    PBMain      pg;
+    gint64      start;
+    PBResult    ret = PB_FAIL;
+
+    pg = pb_bench_new_main(env, 1, NULL);
+
+    start = g_get_monotonic_time();
+
+    if (pb_graph_create_from_deps_file(pg) != PB_OK || pb_graph_calc_nodes_priority(pg) != PB_OK)
+        goto out;
+    pb_graph_order_by_priority(pg);
+
+    *usecs = g_get_monotonic_time() - start;
+
+    if (pb_graph_cache_get_key(pg, key) == PB_OK && pb_graph_cache_save(pg, key) == PB_OK)
+        ret = PB_OK;
+
+out:
+    pb_graph_free(pg);
+
+    return ret;
+}
+
+/**
+ * @brief Load the graph from the graph cache written by pb_bench_parse(), including the hash of the inputs
+ * @param env The environment, pointing to the temporary directory
+ * @param usecs Where the elapsed time is stored
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_bench_load_cache(PBEnv env, gint64 *usecs)
+{
+    guint8      key[PB_GRAPH_CACHE_KEY_LEN];
+    PBMain      pg;
+    gint64      start;
+    PBResult    ret = PB_FAIL;
+
+    pg = pb_bench_new_main(env, 1, NULL);
+
+    start = g_get_monotonic_time();
+
+    if (pb_graph_cache_get_key(pg, key) == PB_OK && pb_graph_cache_load(pg, key) == PB_OK) {
+        *usecs = g_get_monotonic_time() - start;
+        ret = PB_OK;
+    }
+
+    pb_graph_free(pg);
+
+    return ret;
+}
+
+static void pb_bench_print(const gchar *what, gint64 *usecs, guint iterations)
+{
+    gint64  total = 0,
+            min = G_MAXINT64;
+    guint   i;
+
+    for (i = 0; i < iterations; i++) {
+        total += usecs[i];
+        min = MIN(min, usecs[i]);
+    }
+
+    printf("%-28s min %8.3f ms   avg %8.3f ms\n", what, min / 1000.0, total / 1000.0 / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    struct pbuilder_env_st env;
+    struct pbuilder_bench_deps_st deps;
+    gint64      *parse_usecs,
+                *cache_usecs;
+    gchar       *cache;
+    guint       packages = PB_BENCH_PACKAGES,
+                iterations = PB_BENCH_ITERATIONS,
+                i;
+    gint        ret = EXIT_SUCCESS;
+
+    if (argc > 1)
+        packages = MAX(atoi(argv[1]), 1);
+    if (argc > 2)
+        iterations = MAX(atoi(argv[2]), 1);
+
+    if ((cache = pb_bench_init(&env)) == NULL)
+        return EXIT_FAILURE;
+
+    parse_usecs = g_new0(gint64, iterations);
+    cache_usecs = g_new0(gint64, iterations);
+
+    if (pb_bench_write_deps(deps_file, PB_BENCH_META, packages, &deps) != PB_OK)
+        ret = EXIT_FAILURE;
+    else
+        printf("Dependencies file: %u packages, %u dependencies, %" G_GSIZE_FORMAT " bytes, longest line %u bytes\n",
+            packages, deps.edges, deps.size, deps.longest);
+
+    for (i = 0; ret == EXIT_SUCCESS && i < iterations; i++)
+        if (pb_bench_parse(&env, &parse_usecs[i]) != PB_OK)
+            ret = EXIT_FAILURE;
+
+    /* The last iteration left the cache of the file */
+    for (i = 0; ret == EXIT_SUCCESS && i < iterations; i++)
+        if (pb_bench_load_cache(&env, &cache_usecs[i]) != PB_OK)
+            ret = EXIT_FAILURE;
+
+    if (ret == EXIT_SUCCESS) {
+        printf("\n");
+        pb_bench_print("Parse, prioritize and sort:", parse_usecs, iterations);
+        pb_bench_print("Load from the graph cache:", cache_usecs, iterations);
+    }
+
+    pb_bench_cleanup(&env, cache);
+
+    g_free(parse_usecs);
+    g_free(cache_usecs);
+
+    return ret;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file bench_graph.c
+ * @brief Benchmark of the phases of pbuilder that scale with the size of the graph.
+ * It writes synthetic dependencies files of several shapes and sizes and, for each one,
+ * measures the time required to parse the file, to calculate the priorities, to sort
+ * the nodes by priority, to calculate the critical path, to save and load the graph cache
+ * and to schedule the whole graph in virtual time, along with the peak RSS.
+ * Each file is benchmarked in a child process, so its peak RSS is its own.
+ * Usage: bench_graph [-s SHAPE] [-n PACKAGES] [-i ITERATIONS] [-c SLOTS] [-o FILE]
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <fcntl.h>
+
+#include "bench_common.h"
+#include "sim.h"
+
+#define PB_BENCH_ITERATIONS         3
+#define PB_BENCH_SLOTS              16
+
+static gchar    *bench_shape;
+static gint     bench_packages;
+static gint     bench_iterations = PB_BENCH_ITERATIONS;
+static gchar    *bench_output;
+
+static const guint pb_bench_sizes[] = { 100, 1000, 10000, 50000 };
+
+typedef enum
+{
+    PB_BENCH_PARSE,
+    PB_BENCH_PRIORITY,
+    PB_BENCH_SORT,
+    PB_BENCH_CRITICAL_PATH,
+    PB_BENCH_CACHE_SAVE,
+    PB_BENCH_CACHE_LOAD,
+    PB_BENCH_SCHEDULE,
+    PB_BENCH_PHASES_NUM
+} PBBenchPhase;
+
+static const gchar * const pb_bench_phases[PB_BENCH_PHASES_NUM] =
+    { "parse", "priority", "sort", "crit-path", "cache-save", "cache-load", "schedule" };
+
+static GOptionEntry opt_entries[] =
+{
+    { "shape", 's', 0, G_OPTION_ARG_STRING, &bench_shape,
+        "Shape of the graph. Values: layered, wide, chain, meta. Default: all of them", NULL },
+    { "packages", 'n', 0, G_OPTION_ARG_INT, &bench_packages,
+        "Number of packages. Default: 100, 1000, 10000 and 50000", NULL },
+    { "iterations", 'i', 0, G_OPTION_ARG_INT, &bench_iterations,
+        "Number of iterations, the fastest one is shown. Default: 3", NULL },
+    { "cpu", 'c', 0, G_OPTION_ARG_INT, &cpu_num,
+        "Number of slots of the scheduled build. Default: 16", NULL },
+    { "schedule", 'p', 0, G_OPTION_ARG_STRING, &schedule,
+        "Scheduling policy of the scheduled build. Default: priority", NULL },
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &bench_output,
+        "Only write the dependencies file of a shape and a number of packages to a file", NULL },
+    { NULL }
+};
+
+static void pb_bench_lap(gint64 *usecs, PBBenchPhase phase, gint64 *start)
+{
+    gint64  now = g_get_monotonic_time();
+
+    usecs[phase] = MIN(usecs[phase], now - *start);
+    *start = now;
+}
+
+/**
+ * @brief Run every phase once, as pbuilder does before and while building, keeping the fastest time of each one
+ * @param env The environment, pointing to the temporary directory
+ * @param cache The graph cache file
+ * @param usecs The fastest time of each phase
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_bench_run_phases(PBEnv env, const gchar *cache, gint64 *usecs)
+{
+    guint8      key[PB_GRAPH_CACHE_KEY_LEN];
+    PBMain      pg;
+    gint64      start;
+    PBResult    ret = PB_FAIL;
+
+    pg = pb_bench_new_main(env, (cpu_num > 0) ? cpu_num : PB_BENCH_SLOTS, schedule);
+    unlink(cache);
+
+    start = g_get_monotonic_time();
+
+    if (pb_graph_create_from_deps_file(pg) != PB_OK)
+        goto out;
+    pb_bench_lap(usecs, PB_BENCH_PARSE, &start);
+
+    if (pb_graph_calc_nodes_priority(pg) != PB_OK)
+        goto out;
+    pb_bench_lap(usecs, PB_BENCH_PRIORITY, &start);
+
+    pb_graph_order_by_priority(pg);
+    pb_bench_lap(usecs, PB_BENCH_SORT, &start);
+
+    if (pb_history_load(pg) != PB_OK)
+        goto out;
+    pb_graph_calc_critical_path(pg);
+    pb_sched_init(pg);
+    pb_bench_lap(usecs, PB_BENCH_CRITICAL_PATH, &start);
+
+    if (pb_graph_cache_get_key(pg, key) != PB_OK || pb_graph_cache_save(pg, key) != PB_OK)
+        goto out;
+    pb_bench_lap(usecs, PB_BENCH_CACHE_SAVE, &start);
+
+    if (pb_sim_run(pg, PB_SIM_LOGNORMAL) != PB_OK)
+        goto out;
+    pb_bench_lap(usecs, PB_BENCH_SCHEDULE, &start);
+
+    pb_graph_free(pg);
+
+    /* The whole creation of the graph when the cache is valid. pb_graph_create() frees the main struct if it fails */
+    pg = pb_bench_new_main(env, (cpu_num > 0) ? cpu_num : PB_BENCH_SLOTS, schedule);
+    start = g_get_monotonic_time();
+    if (pb_graph_create(pg) != PB_OK)
+        return PB_FAIL;
+    pb_bench_lap(usecs, PB_BENCH_CACHE_LOAD, &start);
+
+    ret = PB_OK;
+
+out:
+    pb_graph_free(pg);
+
+    return ret;
+}
+
+/**
+ * @brief Benchmark a dependencies file in a child process, whose output is discarded,
+ * and print the fastest time of each phase and the peak RSS of the child
+ * @param env The environment, pointing to the temporary directory
+ * @param cache The graph cache file
+ * @param shape The shape of the graph
+ * @param packages Number of packages
+ * @param edges Number of dependencies
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_bench_file(PBEnv env, const gchar *cache, PBBenchShape shape, guint packages, guint edges)
+{
+    struct rusage   ru;
+    gint64  usecs[PB_BENCH_PHASES_NUM];
+    gint    fds[2],
+            status,
+            null_fd,
+            i;
+    pid_t   pid;
+
+    if (pipe(fds) < 0) {
+        pb_log(PB_ERR, "%s(): pipe(): %s\n", __func__, strerror(errno));
+        return PB_FAIL;
+    }
+
+    fflush(stdout);
+
+    if ((pid = fork()) < 0) {
+        pb_log(PB_ERR, "%s(): fork(): %s\n", __func__, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return PB_FAIL;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        if ((null_fd = open("/dev/null", O_WRONLY)) >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+
+        for (i = 0; i < PB_BENCH_PHASES_NUM; i++)
+            usecs[i] = G_MAXINT64;
+
+        for (i = 0; i < bench_iterations; i++)
+            if (pb_bench_run_phases(env, cache, usecs) != PB_OK)
+                _exit(EXIT_FAILURE);
+
+        if (write(fds[1], usecs, sizeof(usecs)) != sizeof(usecs))
+            _exit(EXIT_FAILURE);
+
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    i = read(fds[0], usecs, sizeof(usecs));
+    close(fds[0]);
+
+    if (wait4(pid, &status, 0, &ru) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || i != sizeof(usecs)) {
+        pb_log(PB_ERR, "%s(): Failed to benchmark the %s graph of %u packages\n", __func__, pb_bench_shapes[shape], packages);
+        return PB_FAIL;
+    }
+
+    printf("%-8s %8u %8u", pb_bench_shapes[shape], packages, edges);
+    for (i = 0; i < PB_BENCH_PHASES_NUM; i++)
+        printf(" %10.3f", usecs[i] / 1000.0);
+    printf(" %9.1f\n", ru.ru_maxrss / 1024.0);
+
+    return PB_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    GOptionContext  *opt_context;
+    GError          *error = NULL;
+    struct pbuilder_env_st env;
+    struct pbuilder_bench_deps_st deps;
+    gchar       *cache;
+    guint       n,
+                i;
+    gint        shape = -1,
+                s,
+                ret = EXIT_SUCCESS;
+
+    opt_context = g_option_context_new("- benchmark of the creation and scheduling of synthetic graphs");
+    g_option_context_add_main_entries(opt_context, opt_entries, NULL);
+    if (!g_option_context_parse(opt_context, &argc, &argv, &error)) {
+        pb_log(PB_ERR, "Error while parsing options: %s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(opt_context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(opt_context);
+
+    if (bench_shape && (shape = pb_bench_find_shape(bench_shape)) < 0) {
+        pb_log(PB_ERR, "Invalid shape '%s'. Valid shapes: layered, wide, chain, meta\n", bench_shape);
+        return EXIT_FAILURE;
+    }
+
+    if (schedule && !pb_sched_find(schedule)) {
+        pb_log(PB_ERR, "Invalid scheduling policy '%s'\n", schedule);
+        return EXIT_FAILURE;
+    }
+
+    bench_iterations = MAX(bench_iterations, 1);
+
+    if (bench_output) {
+        if (shape < 0 || bench_packages < 1) {
+            pb_log(PB_ERR, "Writing a dependencies file requires a shape (-s) and a number of packages (-n)\n");
+            return EXIT_FAILURE;
+        }
+        if (pb_bench_write_deps(bench_output, shape, bench_packages, &deps) != PB_OK)
+            return EXIT_FAILURE;
+        printf("%s: %s graph of %u packages and %u dependencies\n", bench_output, bench_shape, bench_packages, deps.edges);
+        return EXIT_SUCCESS;
+    }
+
+    if ((cache = pb_bench_init(&env)) == NULL)
+        return EXIT_FAILURE;
+
+    printf("Fastest of %d iterations in ms, scheduled in %d slots with the '%s' policy. Peak RSS in MB\n\n",
+        bench_iterations, (cpu_num > 0) ? cpu_num : PB_BENCH_SLOTS, schedule ? schedule : SCHED_DEFAULT);
+    printf("%-8s %8s %8s", "shape", "packages", "deps");
+    for (i = 0; i < PB_BENCH_PHASES_NUM; i++)
+        printf(" %10s", pb_bench_phases[i]);
+    printf(" %9s\n", "peak-rss");
+
+    for (s = 0; ret == EXIT_SUCCESS && s < PB_BENCH_SHAPES_NUM; s++) {
+        if (shape >= 0 && s != shape)
+            continue;
+
+        for (i = 0; ret == EXIT_SUCCESS && i < G_N_ELEMENTS(pb_bench_sizes); i++) {
+            n = (bench_packages > 0) ? (guint)bench_packages : pb_bench_sizes[i];
+
+            if (pb_bench_write_deps(deps_file, s, n, &deps) != PB_OK ||
+                    pb_bench_file(&env, cache, s, n, deps.edges) != PB_OK)
+                ret = EXIT_FAILURE;
+
+            if (bench_packages > 0)
+                break;
+        }
+    }
+
+    pb_bench_cleanup(&env, cache);
+
+    return ret;
+}
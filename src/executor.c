@@ -0,0 +1,302 @@
+/**
+ * @file executor.c
+ * @brief Start 'make <package>' with posix_spawnp(), without a shell in between, and watch
+ * the output pipes and the pidfds of all the running packages from a single epoll loop,
+ * so the number of threads and the overhead of each build don't depend on the number of slots.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "executor.h"
+#include "logs.h"
+#include "mem.h"
+
+extern char **environ;
+
+/* The epoll data of a pipe is the node id shifted two bits. The one of a pidfd has the first bit set
+ * and the ones of a prefetch process have the second bit set */
+#define PB_EXEC_EV_PIDFD            G_GUINT64_CONSTANT(1)
+#define PB_EXEC_EV_PREFETCH         G_GUINT64_CONSTANT(2)
+#define PB_EXEC_EV_SHIFT            2
+
+/**
+ * @brief Start 'make <target>' with its stdout and stderr sent to a pipe and its stdin
+ * from /dev/null. The environment is inherited, including BR2_EXTERNAL and the jobserver.
+ * @param target The make target
+ * @param pid Where the process id is stored
+ * @param out_fd Where the read end of the pipe is stored
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_exec_spawn_make(const gchar *target, pid_t *pid, gint *out_fd)
+{
+    posix_spawn_file_actions_t  actions;
+    gchar       *argv[] = { "make", (gchar *)target, NULL };
+    gint        fds[2],
+                ret;
+
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        pb_log(PB_ERR, "%s(): pipe2(): %s\n", __func__, strerror(errno));
+        return PB_FAIL;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+    ret = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    /* Larger pipes let the output be moved to the logs in larger chunks */
+    fcntl(fds[0], F_SETPIPE_SZ, PB_LOGS_PIPE_SIZE);
+
+    if (ret != 0) {
+        pb_log(PB_ERR, "%s(): posix_spawnp(): make %s: %s\n", __func__, target, strerror(ret));
+        close(fds[0]);
+        return PB_FAIL;
+    }
+
+    *out_fd = fds[0];
+
+    return PB_OK;
+}
+
+/**
+ * @brief Create the epoll instance
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_exec_init(PBMain pg)
+{
+    if (!pg)
+        return PB_FAIL;
+
+    pg->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pg->epoll_fd < 0) {
+        pb_log(PB_ERR, "%s(): epoll_create1(): %s\n", __func__, strerror(errno));
+        return PB_FAIL;
+    }
+
+    return PB_OK;
+}
+
+/**
+ * @brief Start 'make <target>' for a node and watch its output and its exit
+ * @param pg Main struct
+ * @param node The node
+ * @param target The make target, also used as the name of the log
+ * @param prefetch It's a prefetch process of the node
+ * @return The process or NULL if it couldn't be started
+ */
+static PBProc pb_exec_proc_start(PBMain pg, PBNode node, const gchar *target, gboolean prefetch)
+{
+    struct epoll_event  ev;
+    PBProc      proc;
+    guint64     data = ((guint64)node->id << PB_EXEC_EV_SHIFT) | (prefetch ? PB_EXEC_EV_PREFETCH : 0);
+
+    proc = g_new0(struct pbuilder_proc_st, 1);
+    proc->node = node;
+    proc->prefetch = prefetch;
+    proc->out_fd = -1;
+    proc->pid_fd = -1;
+
+    /* Write output to ${CONFIG_DIR}/pbuilder_logs/<target>.log */
+    proc->log = pb_logs_open(pg, target);
+
+    if (pb_exec_spawn_make(target, &proc->pid, &proc->out_fd) != PB_OK) {
+        pb_exec_proc_free(proc);
+        return NULL;
+    }
+
+    fcntl(proc->out_fd, F_SETFL, fcntl(proc->out_fd, F_GETFL) | O_NONBLOCK);
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = data;
+    epoll_ctl(pg->epoll_fd, EPOLL_CTL_ADD, proc->out_fd, &ev);
+
+    /* Without pidfd (Linux < 5.3), make is reaped when its output is closed */
+#ifdef SYS_pidfd_open
+    proc->pid_fd = syscall(SYS_pidfd_open, proc->pid, 0);
+#else
+    proc->pid_fd = -1;
+#endif
+    if (proc->pid_fd >= 0) {
+        fcntl(proc->pid_fd, F_SETFD, FD_CLOEXEC);
+        ev.events = EPOLLIN;
+        ev.data.u64 = data | PB_EXEC_EV_PIDFD;
+        epoll_ctl(pg->epoll_fd, EPOLL_CTL_ADD, proc->pid_fd, &ev);
+    }
+
+    return proc;
+}
+
+/**
+ * @brief Start building a node and watch its output and its exit
+ * @param pg Main struct
+ * @param node The node to be built
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_exec_start(PBMain pg, PBNode node)
+{
+    node->start_usecs = g_get_monotonic_time();
+    node->oom_hint = FALSE;
+
+    if ((node->proc = pb_exec_proc_start(pg, node, node->name, FALSE)) == NULL)
+        return PB_FAIL;
+
+    return PB_OK;
+}
+
+/**
+ * @brief Start downloading the sources of a node before it's built, in a process
+ * that doesn't use any slot. It's finished by pb_exec_wait() like the builds.
+ * @param pg Main struct
+ * @param node The node
+ * @param target The make target: <package>-source or <package>-extract
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_exec_start_prefetch(PBMain pg, PBNode node, const gchar *target)
+{
+    if ((node->prefetch_proc = pb_exec_proc_start(pg, node, target, TRUE)) == NULL)
+        return PB_FAIL;
+
+    return PB_OK;
+}
+
+/**
+ * @brief Move all the output available in the pipe of a process to its log
+ * and close the pipe when make and everything that inherited it are gone
+ * @param pg Main struct
+ * @param proc The process
+ */
+static void pb_exec_read_output(PBMain pg, PBProc proc)
+{
+    gssize  len;
+
+    while ((len = pb_logs_transfer(proc->log, proc->out_fd)) > 0)
+        ;
+
+    if (proc->log && proc->log->oom_hint && !proc->prefetch)
+        proc->node->oom_hint = TRUE;
+
+    if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+        epoll_ctl(pg->epoll_fd, EPOLL_CTL_DEL, proc->out_fd, NULL);
+        close(proc->out_fd);
+        proc->out_fd = -1;
+    }
+}
+
+/**
+ * @brief Reap a make process and get the resources it used
+ * @param pg Main struct
+ * @param proc The process
+ */
+static void pb_exec_reap(PBMain pg, PBProc proc)
+{
+    while (wait4(proc->pid, &proc->status, 0, &proc->ru) < 0 && errno == EINTR)
+        ;
+
+    proc->exited = TRUE;
+
+    if (proc->pid_fd >= 0) {
+        epoll_ctl(pg->epoll_fd, EPOLL_CTL_DEL, proc->pid_fd, NULL);
+        close(proc->pid_fd);
+        proc->pid_fd = -1;
+    }
+}
+
+/**
+ * @brief Wait until a process exits or until a deadline and handle the output of the running processes.
+ * A process is finished when make has exited. Its remaining output is read then, and the pipe is closed
+ * even if a background process still has it open.
+ * @param pg Main struct
+ * @param deadline Monotonic time when it has to return or G_MAXINT64 to wait without a deadline
+ * @param done Where the finished processes are added. They must be freed by the caller
+ */
+void pb_exec_wait(PBMain pg, gint64 deadline, GPtrArray *done)
+{
+    struct epoll_event  events[PB_EXEC_MAX_EVENTS];
+    gint        timeout = -1,
+                n,
+                i;
+
+    if (deadline != G_MAXINT64)
+        timeout = MAX(0, (deadline - g_get_monotonic_time() + 999) / 1000);
+
+    n = epoll_wait(pg->epoll_fd, events, PB_EXEC_MAX_EVENTS, timeout);
+    if (n < 0 && errno != EINTR)
+        pb_log(PB_ERR, "%s(): epoll_wait(): %s\n", __func__, strerror(errno));
+
+    for (i = 0; i < n; i++) {
+        PBNode  node = &pg->nodes[events[i].data.u64 >> PB_EXEC_EV_SHIFT];
+        PBProc  proc = (events[i].data.u64 & PB_EXEC_EV_PREFETCH) ? node->prefetch_proc : node->proc;
+
+        if (!proc || proc->exited)
+            continue;
+
+        if (events[i].data.u64 & PB_EXEC_EV_PIDFD)
+            pb_exec_reap(pg, proc);
+        else if (proc->out_fd >= 0) {
+            pb_exec_read_output(pg, proc);
+            if (proc->out_fd < 0 && proc->pid_fd < 0)
+                pb_exec_reap(pg, proc);
+        }
+
+        if (!proc->exited)
+            continue;
+
+        if (proc->out_fd >= 0) {
+            pb_exec_read_output(pg, proc);
+            if (proc->out_fd >= 0) {
+                epoll_ctl(pg->epoll_fd, EPOLL_CTL_DEL, proc->out_fd, NULL);
+                close(proc->out_fd);
+                proc->out_fd = -1;
+            }
+        }
+
+        if (proc->prefetch)
+            node->prefetch_proc = NULL;
+        else
+            node->proc = NULL;
+        g_ptr_array_add(done, proc);
+    }
+}
+
+/**
+ * @brief Free a finished process
+ * @param proc The process
+ */
+void pb_exec_proc_free(PBProc proc)
+{
+    if (!proc)
+        return;
+
+    if (proc->out_fd >= 0)
+        close(proc->out_fd);
+    if (proc->pid_fd >= 0)
+        close(proc->pid_fd);
+    pb_logs_close(proc->log);
+
+    g_free(proc);
+}
+
+/**
+ * @brief Close the epoll instance
+ * @param pg Main struct
+ */
+void pb_exec_free(PBMain pg)
+{
+    if (pg && pg->epoll_fd >= 0) {
+        close(pg->epoll_fd);
+        pg->epoll_fd = -1;
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * @file executor.h
+ * @brief Start the make processes and watch all of them from a single thread
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _EXECUTOR_H_
+#define _EXECUTOR_H_
+
+#include "graph_common.h"
+#include "logs.h"
+#include "utils.h"
+
+/**
+ * Max number of events handled by each epoll_wait()
+ */
+#define PB_EXEC_MAX_EVENTS          64
+
+typedef struct pbuilder_proc_st *   PBProc;
+
+/**
+ * A 'make <package>' process being built or a prefetch process
+ */
+struct pbuilder_proc_st
+{
+    PBNode          node;               /**< The node being built */
+    gboolean        prefetch;           /**< It downloads the sources of the node instead of building it */
+    pid_t           pid;                /**< Process id of make */
+    gint            out_fd;             /**< Read end of its stdout and stderr or -1 once closed */
+    gint            pid_fd;             /**< pidfd readable when make exits or -1 if not supported */
+    PBLog           log;                /**< ${CONFIG_DIR}/pbuilder_logs/<package>.log or NULL */
+    gboolean        exited;             /**< make was reaped */
+    gint            status;             /**< Status returned by wait4() */
+    struct rusage   ru;                 /**< Resources used by make and all its descendants */
+};
+
+PBResult    pb_exec_spawn_make(const gchar *, pid_t *, gint *);
+PBResult    pb_exec_init(PBMain);
+PBResult    pb_exec_start(PBMain, PBNode);
+PBResult    pb_exec_start_prefetch(PBMain, PBNode, const gchar *);
+void        pb_exec_wait(PBMain, gint64, GPtrArray *);
+void        pb_exec_proc_free(PBProc);
+void        pb_exec_free(PBMain);
+
+#endif  /* _EXECUTOR_H_ */
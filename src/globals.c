@@ -0,0 +1,30 @@
+/**
+ * @file globals.c
+ * @brief Global variables set from the cmdline. They're declared in utils.h and
+ * defined here, so pbuilder and the benchmarks link the same definitions.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "utils.h"
+#include "logs.h"
+
+gint    debug_level;
+gchar   *debug_module;
+gchar   *deps_file;
+gchar   *show_info;
+gboolean split_steps;
+gint    cpu_num;
+gchar   *schedule;
+gint    jobs;
+gchar   *adaptive;
+gint    mem_budget;
+gint    prefetch;
+gboolean prefetch_extract;
+gchar   *log_compress;
+gint    log_tail = PB_LOGS_TAIL_LINES;
+gchar   *trace_file;
+gboolean keep_going;
+gchar   *simulate;
@@ -0,0 +1,364 @@
+/**
+ * @file graph_cache.c
+ * @brief Save the graph, once its nodes are linked and sorted by priority, in a compact binary
+ * file that is mapped in memory by the next runs instead of parsing and sorting it again.
+ * The cache is keyed by a hash of Buildroot's .config and the input the graph was created from,
+ * so any change in them makes the graph be created from scratch and the cache be written again.
+ * The building times are not cached, since the history changes in every run.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "graph_cache.h"
+#include "show_info.h"
+
+/**
+ * @brief Add the contents of a file to the hash, preceded by its length so the
+ * boundaries between the inputs are part of the hash too
+ * @param sum The hash
+ * @param path The file
+ * @return TRUE if the file was read, FALSE otherwise
+ */
+static gboolean pb_graph_cache_hash_file(GChecksum *sum, const gchar *path)
+{
+    GMappedFile *map;
+    guint64     len;
+
+    if ((map = g_mapped_file_new(path, FALSE, NULL)) == NULL)
+        return FALSE;
+
+    len = g_mapped_file_get_length(map);
+    g_checksum_update(sum, (const guchar *)&len, sizeof(len));
+    if (len > 0)
+        g_checksum_update(sum, (const guchar *)g_mapped_file_get_contents(map), len);
+
+    g_mapped_file_unref(map);
+
+    return TRUE;
+}
+
+static gchar * pb_graph_cache_get_path(PBMain pg)
+{
+    return g_strdup_printf("%s/%s", pg->env->config_dir, PB_GRAPH_CACHE_FILE);
+}
+
+/**
+ * @brief Calculate the key of the cache: a hash of Buildroot's .config, BR2_EXTERNAL and
+ * the dependencies file or show-info file. When show-info is run by pbuilder, the file where
+ * its output was saved is hashed, so 'make show-info' must have been run before.
+ * There's no key when show-info is read from stdin.
+ * Whether the packages are split into steps is part of the key too.
+ * @param pg Main struct
+ * @param key Where the PB_GRAPH_CACHE_KEY_LEN bytes of the key are stored
+ * @return PB_OK if successful, PB_FAIL if the graph can't be cached
+ */
+PBResult pb_graph_cache_get_key(PBMain pg, guint8 *key)
+{
+    GChecksum   *sum;
+    gchar       *config,
+                *path;
+    gsize       len = PB_GRAPH_CACHE_KEY_LEN;
+    guint32     version = PB_GRAPH_CACHE_VERSION;
+    PBResult    ret = PB_OK;
+
+    if (!pg || !pg->env || !g_strcmp0(show_info, PB_SHOW_INFO_STDIN))
+        return PB_FAIL;
+
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+
+    g_checksum_update(sum, (const guchar *)&version, sizeof(version));
+    g_checksum_update(sum, (const guchar *)(show_info ? "i" : "f"), 1);
+    g_checksum_update(sum, (const guchar *)(split_steps ? "s" : "p"), 1);
+
+    /* A missing .config is hashed as an empty one */
+    config = g_strdup_printf("%s/.config", pg->env->config_dir);
+    if (!pb_graph_cache_hash_file(sum, config))
+        g_checksum_update(sum, (const guchar *)"", 1);
+    g_free(config);
+
+    g_checksum_update(sum, (const guchar *)pg->env->br2_external, strlen(pg->env->br2_external) + 1);
+
+    if (!show_info)
+        ret = pb_graph_cache_hash_file(sum, deps_file) ? PB_OK : PB_FAIL;
+    else {
+        path = pb_show_info_get_path(pg);
+        ret = pb_graph_cache_hash_file(sum, path) ? PB_OK : PB_FAIL;
+        g_free(path);
+    }
+
+    g_checksum_get_digest(sum, key, &len);
+    g_checksum_free(sum);
+
+    return ret;
+}
+
+/**
+ * @brief Check that the CSR offsets of the cache are increasing and the ids are valid nodes
+ * @param off The offsets, nodes_num + 1 elements
+ * @param ids The ids, edges_num elements
+ * @param nodes_num Number of nodes
+ * @param edges_num Number of edges
+ * @return TRUE if they're valid, FALSE otherwise
+ */
+static gboolean pb_graph_cache_check_csr(const guint32 *off, const guint32 *ids, guint32 nodes_num, guint32 edges_num)
+{
+    guint32 i;
+
+    if (off[0] != 0 || off[nodes_num] != edges_num)
+        return FALSE;
+
+    for (i = 0; i < nodes_num; i++)
+        if (off[i] > off[i + 1])
+            return FALSE;
+
+    for (i = 0; i < edges_num; i++)
+        if (ids[i] >= nodes_num)
+            return FALSE;
+
+    return TRUE;
+}
+
+/**
+ * @brief Copy an array of ids or offsets of the mapped cache to memory owned by the graph
+ * @param ids The array in the mapped file
+ * @param len Number of elements
+ * @return The copy, to be freed with g_free()
+ */
+static guint * pb_graph_cache_copy_ids(const guint32 *ids, guint32 len)
+{
+    guint   *copy = g_new(guint, len);
+
+    memcpy(copy, ids, len * sizeof(guint));
+
+    return copy;
+}
+
+/**
+ * @brief Load the graph from the cache if it was created from the same inputs.
+ * The names and versions of the nodes point to the mapped file, which is kept until
+ * the graph is freed. Nothing is changed in the main struct if the cache can't be used.
+ * @param pg Main struct
+ * @param key The key of the current inputs
+ * @return PB_OK if the graph was loaded, PB_FAIL otherwise
+ */
+PBResult pb_graph_cache_load(PBMain pg, const guint8 *key)
+{
+    const struct pbuilder_graph_cache_header_st *hdr;
+    const struct pbuilder_graph_cache_node_st *cnodes;
+    const guint32   *sorted,
+                    *parents_off,
+                    *parents,
+                    *children_off,
+                    *children;
+    const gchar     *names;
+    GMappedFile     *map;
+    gchar           *path;
+    guint64         len;
+    guint32         n,
+                    e,
+                    i;
+
+    path = pb_graph_cache_get_path(pg);
+    map = g_mapped_file_new(path, FALSE, NULL);
+    g_free(path);
+
+    if (!map)
+        return PB_FAIL;
+
+    len = g_mapped_file_get_length(map);
+    hdr = (const struct pbuilder_graph_cache_header_st *)g_mapped_file_get_contents(map);
+
+    if (len < sizeof(*hdr) || memcmp(hdr->magic, PB_GRAPH_CACHE_MAGIC, sizeof(PB_GRAPH_CACHE_MAGIC)) ||
+        hdr->version != PB_GRAPH_CACHE_VERSION) {
+        pb_debug(1, DBG_CREATE, "The graph cache has an unknown format\n");
+        goto invalid;
+    }
+
+    if (memcmp(hdr->key, key, PB_GRAPH_CACHE_KEY_LEN)) {
+        pb_debug(1, DBG_CREATE, "The graph cache was created from other inputs\n");
+        goto invalid;
+    }
+
+    n = hdr->nodes_num;
+    e = hdr->edges_num;
+
+    if (n == 0 || hdr->names_size == 0 ||
+        len != sizeof(*hdr) + (guint64)n * sizeof(*cnodes) + ((guint64)n * 3 + 2 + (guint64)e * 2) * sizeof(guint32)
+            + hdr->names_size) {
+        pb_debug(1, DBG_CREATE, "The graph cache is truncated\n");
+        goto invalid;
+    }
+
+    cnodes = (const struct pbuilder_graph_cache_node_st *)(hdr + 1);
+    sorted = (const guint32 *)(cnodes + n);
+    parents_off = sorted + n;
+    parents = parents_off + n + 1;
+    children_off = parents + e;
+    children = children_off + n + 1;
+    names = (const gchar *)(children + e);
+
+    if (names[hdr->names_size - 1] != '\0' ||
+        !pb_graph_cache_check_csr(parents_off, parents, n, e) ||
+        !pb_graph_cache_check_csr(children_off, children, n, e))
+        goto corrupted;
+
+    for (i = 0; i < n; i++) {
+        if (sorted[i] >= n || cnodes[i].name >= hdr->names_size || cnodes[i].version >= hdr->names_size ||
+            cnodes[i].type >= hdr->names_size || cnodes[i].build_system >= hdr->names_size ||
+            cnodes[i].package >= hdr->names_size ||
+            cnodes[i].priority > G_MAXUSHORT)
+            goto corrupted;
+    }
+
+    pg->nodes_num = n;
+    pg->nodes = g_new0(struct pbuilder_node_st, n);
+    pg->sorted = pb_graph_cache_copy_ids(sorted, n);
+    pg->parents_off = pb_graph_cache_copy_ids(parents_off, n + 1);
+    pg->parents = pb_graph_cache_copy_ids(parents, e);
+    pg->children_off = pb_graph_cache_copy_ids(children_off, n + 1);
+    pg->children = pb_graph_cache_copy_ids(children, e);
+    pg->names = g_string_chunk_new(BUFF_1K);
+    pg->nodes_by_name = g_hash_table_new(g_str_hash, g_str_equal);
+    pg->graph_cache = map;
+
+    for (i = 0; i < n; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        node->id = i;
+        node->pg = pg;
+        node->name = names + cnodes[i].name;
+        node->version = names + cnodes[i].version;
+        node->type = names + cnodes[i].type;
+        node->build_system = names + cnodes[i].build_system;
+        node->install = cnodes[i].install;
+        node->package = names + cnodes[i].package;
+        node->steps = cnodes[i].steps;
+        node->priority = cnodes[i].priority;
+        node->status = (i == 0) ? PB_STATUS_DONE : PB_STATUS_READY;
+
+        g_hash_table_insert(pg->nodes_by_name, (gpointer)node->name, GUINT_TO_POINTER(i + 1));
+    }
+
+    pb_log(PB_INFO, "Graph of %u %s loaded from the cache\n", n - 1, split_steps ? "steps" : "packages");
+
+    return PB_OK;
+
+corrupted:
+    pb_log(PB_WARN, "The graph cache is corrupted, creating the graph again\n");
+invalid:
+    g_mapped_file_unref(map);
+    return PB_FAIL;
+}
+
+/**
+ * @brief Add a string to the names of the cache only once
+ * @param names The names
+ * @param offsets Offset of each string already added
+ * @param str The string
+ * @return The offset of the string in the names
+ */
+static guint32 pb_graph_cache_add_name(GString *names, GHashTable *offsets, const gchar *str)
+{
+    gpointer    value;
+    guint32     off;
+
+    if (g_hash_table_lookup_extended(offsets, str, NULL, &value))
+        return GPOINTER_TO_UINT(value);
+
+    off = names->len;
+    g_string_append_len(names, str, strlen(str) + 1);
+    g_hash_table_insert(offsets, (gpointer)str, GUINT_TO_POINTER(off));
+
+    return off;
+}
+
+/**
+ * @brief Write the graph to the cache. The file is replaced atomically,
+ * so a run that is interrupted never leaves a truncated cache.
+ * @param pg Main struct
+ * @param key The key of the inputs the graph was created from
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_graph_cache_save(PBMain pg, const guint8 *key)
+{
+    struct pbuilder_graph_cache_header_st hdr;
+    struct pbuilder_graph_cache_node_st cnode;
+    GHashTable  *offsets;
+    GString     *names,
+                *contents;
+    GError      *error = NULL;
+    gchar       *path;
+    guint32     n = pg->nodes_num,
+                e = pg->parents_off[n],
+                i;
+    PBResult    ret = PB_OK;
+
+    memset(&hdr, 0, sizeof(hdr));
+
+    names = g_string_new(NULL);
+    offsets = g_hash_table_new(g_str_hash, g_str_equal);
+
+    contents = g_string_sized_new(sizeof(hdr) + n * (sizeof(cnode) + 3 * sizeof(guint32)) + e * 2 * sizeof(guint32));
+    g_string_append_len(contents, (const gchar *)&hdr, sizeof(hdr));
+
+    for (i = 0; i < n; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        cnode.name = pb_graph_cache_add_name(names, offsets, node->name);
+        cnode.version = pb_graph_cache_add_name(names, offsets, node->version);
+        cnode.type = pb_graph_cache_add_name(names, offsets, node->type);
+        cnode.build_system = pb_graph_cache_add_name(names, offsets, node->build_system);
+        cnode.install = node->install;
+        cnode.package = pb_graph_cache_add_name(names, offsets, node->package);
+        cnode.steps = node->steps;
+        cnode.priority = node->priority;
+
+        g_string_append_len(contents, (const gchar *)&cnode, sizeof(cnode));
+    }
+
+    g_string_append_len(contents, (const gchar *)pg->sorted, n * sizeof(guint32));
+    g_string_append_len(contents, (const gchar *)pg->parents_off, (n + 1) * sizeof(guint32));
+    g_string_append_len(contents, (const gchar *)pg->parents, e * sizeof(guint32));
+    g_string_append_len(contents, (const gchar *)pg->children_off, (n + 1) * sizeof(guint32));
+    g_string_append_len(contents, (const gchar *)pg->children, e * sizeof(guint32));
+    g_string_append_len(contents, names->str, names->len);
+
+    memcpy(hdr.magic, PB_GRAPH_CACHE_MAGIC, sizeof(PB_GRAPH_CACHE_MAGIC));
+    hdr.version = PB_GRAPH_CACHE_VERSION;
+    hdr.nodes_num = n;
+    hdr.edges_num = e;
+    hdr.names_size = names->len;
+    memcpy(hdr.key, key, PB_GRAPH_CACHE_KEY_LEN);
+    memcpy(contents->str, &hdr, sizeof(hdr));
+
+    path = pb_graph_cache_get_path(pg);
+
+    if (!g_file_set_contents(path, contents->str, contents->len, &error)) {
+        pb_log(PB_WARN, "%s(): Failed to write %s: %s\n", __func__, path, error->message);
+        g_error_free(error);
+        ret = PB_FAIL;
+    }
+    else
+        pb_debug(1, DBG_CREATE, "Graph saved in %s (%" G_GSIZE_FORMAT " bytes)\n", path, contents->len);
+
+    g_free(path);
+    g_string_free(contents, TRUE);
+    g_string_free(names, TRUE);
+    g_hash_table_destroy(offsets);
+
+    return ret;
+}
+
+/**
+ * @brief Unmap the cache used by the graph, if any
+ * @param pg Main struct
+ */
+void pb_graph_cache_free(PBMain pg)
+{
+    if (pg && pg->graph_cache) {
+        g_mapped_file_unref(pg->graph_cache);
+        pg->graph_cache = NULL;
+    }
+}
@@ -0,0 +1,63 @@
+/**
+ * @file graph_cache.h
+ * @brief Binary image of the graph reused by the next runs with the same configuration
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _GRAPH_CACHE_H_
+#define _GRAPH_CACHE_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+#define PB_GRAPH_CACHE_FILE         ".pbuilder.graph"
+#define PB_GRAPH_CACHE_MAGIC        "PBGRAPH"
+
+/**
+ * Format of the cache. It must be increased whenever the layout or the meaning of any field changes
+ */
+#define PB_GRAPH_CACHE_VERSION      2
+
+/**
+ * Length of the key: a SHA-256 digest
+ */
+#define PB_GRAPH_CACHE_KEY_LEN      32
+
+/**
+ * Start of the cache file. It's followed by the nodes, the sorted ids, the CSR arrays
+ * of the parents and the children and the names. All the integers are in host byte order.
+ */
+struct pbuilder_graph_cache_header_st
+{
+    gchar           magic[8];           /**< PB_GRAPH_CACHE_MAGIC */
+    guint32         version;            /**< PB_GRAPH_CACHE_VERSION */
+    guint32         nodes_num;          /**< Number of nodes, including the root */
+    guint32         edges_num;          /**< Number of parent-child edges */
+    guint32         names_size;         /**< Size of the names, including the terminating NULs */
+    guint8          key[PB_GRAPH_CACHE_KEY_LEN];    /**< Hash of the inputs the graph was created from */
+};
+
+/**
+ * A node in the cache. The strings are offsets in the names
+ */
+struct pbuilder_graph_cache_node_st
+{
+    guint32         name;
+    guint32         version;
+    guint32         type;
+    guint32         build_system;
+    guint32         install;
+    guint32         package;
+    guint32         steps;
+    guint32         priority;
+};
+
+PBResult    pb_graph_cache_get_key(PBMain, guint8 *);
+PBResult    pb_graph_cache_load(PBMain, const guint8 *);
+PBResult    pb_graph_cache_save(PBMain, const guint8 *);
+void        pb_graph_cache_free(PBMain);
+
+#endif  /* _GRAPH_CACHE_H_ */
@@ -8,46 +8,28 @@
  */
 
 #include "graph_common.h"
+#include "graph_steps.h"
 #include "utils.h"
 
-PBNode pb_node_find_by_name(GList *list, gchar *str)
-{
-    if (!list || !str)
-        return NULL;
-
-    for (; list != NULL; list = list->next) {
-        PBNode node = list->data;
-
-        if (!g_strcmp0(node->name->str, str)) {
-            pb_debug(3, DBG_ALL, "Found!!!!!\n");
-            return node;
-        }
-    }
-
-    return NULL;
-}
-
 /**
- * @brief Search the name of a node. It's called for each node in the graph
- * @param a A node in the graph
- * @param b The name of the node to search for
- * @return 0 if a node is found, 1 otherwise
+ * @brief Find a node using its package name
+ * @param pg Main struct
+ * @param str The name of the node to search for
+ * @return The node if found, NULL otherwise
  */
-gint pb_node_name_exists(gconstpointer a, gconstpointer b)
+PBNode pb_node_find_by_name(PBMain pg, const gchar *str)
 {
-    const struct pbuilder_node_st *  node = a;
-    const gchar   *str = b;
+    gpointer    value;
 
-    pb_debug(3, DBG_ALL, "\t%s - %s: ", str, node->name->str);
+    if (!pg || !pg->nodes || !pg->nodes_by_name || !str)
+        return NULL;
 
-    if (!g_strcmp0(node->name->str, str)) {
-        pb_debug(3, DBG_ALL, "Found!!!!!\n");
-        return 0;
-    }
-    else
-        pb_debug(3, DBG_ALL, "NOT found\n");
+    /* The index stores the node id plus one, so a NULL value means not found */
+    value = g_hash_table_lookup(pg->nodes_by_name, str);
+    if (!value)
+        return NULL;
 
-    return 1;
+    return &pg->nodes[GPOINTER_TO_UINT(value) - 1];
 }
 
 #if 0
@@ -134,31 +116,22 @@ PBResult pb_finalize_single_target(PBMain pg, const gchar *target)
 }
 #endif
 
-void pb_th_wait_for_all_threads(PBMain pg)
-{
-    while (1) {
-        if (!g_thread_pool_get_num_threads(pg->th_pool))
-            break;
-
-        sleep(1);
-    }
-}
-
 /**
  * @brief Check if a package was already built. If yes, set state to done and return 1.
+ * A node that builds a step of a package checks the stamp of that step.
  * @param node The node to be checked
  * @return 1 if the package was already built, 0 otherwise
  */
 gboolean pb_node_already_built(PBNode node) {
     struct stat sb;
     GString *pkg_path = g_string_new(NULL);
-    g_string_printf(pkg_path, "%s/%s", node->pg->env->build_dir, node->name->str);
+    g_string_printf(pkg_path, "%s/%s", node->pg->env->build_dir, node->package);
 
-    if (node->version->len > 0)
-        g_string_append_printf(pkg_path, "-%s", node->version->str);
+    if (node->version[0] != '\0')
+        g_string_append_printf(pkg_path, "-%s", node->version);
 
     if ((stat(pkg_path->str, &sb) == 0) && S_ISDIR(sb.st_mode)) {
-        g_string_append(pkg_path, "/.stamp_installed");
+        g_string_append_printf(pkg_path, "/%s", pb_graph_steps_get_stamp(node));
         if (stat(pkg_path->str, &sb) == 0) {
             g_string_free(pkg_path, TRUE);
             node->elapsed_secs = 0;
@@ -170,3 +143,16 @@ gboolean pb_node_already_built(PBNode node) {
     return FALSE;
 }
 
+/**
+ * @brief Check if a package is built for the host. The dependencies file has no types,
+ * so Buildroot's naming convention is used then.
+ * @param node The package or one of its steps
+ * @return TRUE if it's a host package, FALSE otherwise
+ */
+gboolean pb_node_is_host(PBNode node)
+{
+    if (node->type[0] != '\0')
+        return !strcmp(node->type, "host");
+
+    return g_str_has_prefix(node->package, "host-");
+}
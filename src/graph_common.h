@@ -17,12 +17,57 @@ typedef enum
     PB_STATUS_PENDING,
     PB_STATUS_READY,
     PB_STATUS_PROCESSING,
-    PB_STATUS_DONE
+    PB_STATUS_DONE,
+    PB_STATUS_BLOCKED
 } PBStatus;
 
+/**
+ * Directories where a package is installed, according to 'make show-info'
+ */
+typedef enum
+{
+    PB_INSTALL_TARGET   = 1 << 0,
+    PB_INSTALL_STAGING  = 1 << 1,
+    PB_INSTALL_IMAGES   = 1 << 2
+} PBInstall;
+
+/**
+ * Steps of the build of a package, as announced by Buildroot's ">>>" lines.
+ * The time before the first line is spent by make reading the Makefiles and checking the dependencies
+ */
+typedef enum
+{
+    PB_STEP_STARTUP,
+    PB_STEP_DOWNLOAD,
+    PB_STEP_EXTRACT,
+    PB_STEP_PATCH,
+    PB_STEP_CONFIGURE,
+    PB_STEP_BUILD,
+    PB_STEP_INSTALL_STAGING,
+    PB_STEP_INSTALL_TARGET,
+    PB_STEP_INSTALL_HOST,
+    PB_STEP_INSTALL_IMAGES,
+    PB_STEP_NUM
+} PBStep;
+
+#define PB_STEP_MASK(step)          (1u << (step))
+
+/**
+ * State of the download of the sources of a node ahead of its build
+ */
+typedef enum
+{
+    PB_PREFETCH_NONE,
+    PB_PREFETCH_RUNNING,
+    PB_PREFETCH_DEFERRED,               /**< Running and the node was about to be built, so it waits for it */
+    PB_PREFETCH_DONE,
+    PB_PREFETCH_FAILED
+} PBPrefetch;
+
 typedef struct pbuilder_main_st *               PBMain;
 typedef struct pbuilder_node_st *               PBNode;
 typedef struct pbuilder_env_st *                PBEnv;
+typedef const struct pbuilder_sched_policy_st * PBSchedPolicy;
 
 /**
  * Store some of Buildroot's environment variables passed from the Makefile
@@ -35,21 +80,50 @@ struct pbuilder_env_st
 };
 
 /**
- * A node of the graph that represents a package to be built
+ * A node of the graph that represents a package to be built.
+ * All the nodes are stored in a single array and its parents and children are
+ * stored as node ids in the CSR arrays of the main struct.
  */
 struct pbuilder_node_st
 {
-    GString         *name;              /**< Package name */
-    GString         *version;           /**< Package version */
+    guint           id;                 /**< Index of the node in the nodes array. The root is 0 */
+    const gchar     *name;              /**< Package name. Interned in the names arena */
+    const gchar     *version;           /**< Package version or an empty string. Interned in the names arena */
+    const gchar     *type;              /**< Package type: target, host, ... or an empty string if unknown. Interned */
+    const gchar     *build_system;      /**< Package infrastructure or an empty string if unknown. Interned */
+    PBInstall       install;            /**< Directories where the package is installed */
+    const gchar     *package;           /**< Package built by the node: the node name, unless it's a step of the package. Interned */
+    guint           steps;              /**< Steps of the package built by the node as a mask of PB_STEP_MASK() or 0 for all of them */
     PBStatus        status;             /**< Node status */
     gushort         priority;           /**< Indicates when this node has to be built */
-    gchar           **parents_str;      /**< List of strings that contain the package parents */
-    GList           *parents;           /**< List that points to this node's parents */
-    GList           *children;          /**< List that points to this node's children */
     PBMain          pg;                 /**< Pointer to the main struct */
-    GTimer          *timer;             /**< Timer needed to measure the node's building time */
     gdouble         elapsed_secs;       /**< Time required to build this node */
     gboolean        build_failed;       /**< Indicates that the package could not be built */
+    gint            exit_status;        /**< Exit status of 'make <package>' */
+    gdouble         weight_secs;        /**< Expected building time taken from previous runs */
+    gdouble         cp_secs;            /**< Expected time of the longest path from this node to a leaf */
+    guint           descendants;        /**< Number of nodes that depend directly or indirectly on this one */
+    gint            pending_parents;    /**< Number of parents not built yet */
+    gint            pending_host_parents;   /**< Number of host parents not built yet */
+    gint64          ready_usecs;        /**< Monotonic time when all its parents were built */
+    gint64          start_usecs;        /**< Monotonic time when its make process started */
+    gint64          end_usecs;          /**< Monotonic time when it was done */
+    struct pbuilder_proc_st *proc;      /**< Its make process while it's being built */
+    guint           slot;               /**< Slot used while it's being built, from 0 */
+    gchar           job_token;          /**< Jobserver token held while building or 0 if it's the implicit one */
+    gint64          weight_rss_kb;      /**< Expected peak RSS in kB taken from previous runs */
+    gint64          maxrss_kb;          /**< Peak RSS in kB of its largest process in this run */
+    gdouble         utime_secs;         /**< User CPU time of make and all its descendants */
+    gdouble         stime_secs;         /**< System CPU time of make and all its descendants */
+    glong           inblock;            /**< Number of block input operations */
+    glong           oublock;            /**< Number of block output operations */
+    glong           nvcsw;              /**< Number of voluntary context switches */
+    glong           nivcsw;             /**< Number of involuntary context switches */
+    gboolean        oom_hint;           /**< The build output says that the compiler was killed */
+    guint           oom_retries;        /**< Number of times it was built again after being killed by the OOM killer */
+    gdouble         step_secs[PB_STEP_NUM]; /**< Time spent in each step of its last build */
+    PBPrefetch      prefetch;           /**< State of the download of its sources ahead of the build */
+    struct pbuilder_proc_st *prefetch_proc; /**< Its prefetch process while the sources are being downloaded */
 };
 
 /**
@@ -57,22 +131,73 @@ struct pbuilder_node_st
  */
 struct pbuilder_main_st
 {
-    GList           *graph;             /**< Graph used to build */
+    PBNode          nodes;              /**< Graph used to build: array of nodes. The root 'ALL' is the first one */
+    guint           nodes_num;          /**< Number of nodes in the graph, including the root */
+    guint           *sorted;            /**< Node ids sorted by building priority */
+    guint           *parents_off;       /**< The parents of node i are parents[parents_off[i]] to parents[parents_off[i + 1] - 1] */
+    guint           *parents;           /**< Ids of the parents of all the nodes */
+    guint           *children_off;      /**< The children of node i are children[children_off[i]] to children[children_off[i + 1] - 1] */
+    guint           *children;          /**< Ids of the children of all the nodes */
+    GStringChunk    *names;             /**< Arena where the package names and versions are interned */
+    GHashTable      *nodes_by_name;     /**< Index of the graph nodes using the package name as key */
+    GMappedFile     *graph_cache;       /**< Graph cache the names point to when the graph was loaded from it */
     GList           *br_pkg_list;       /**< List of buildroot package names */
-    gushort         cpu_num;            /**< Number of CPUs that determine the number of threads used to build */
-    GThreadPool     *th_pool;           /**< Pool of threads of size cpu_num */
+    PBSchedPolicy   policy;             /**< Scheduling policy: order in which the ready nodes are built */
+    GHashTable      *history;           /**< Samples of the building time of each package in previous runs */
+    guint           history_known;      /**< Number of nodes whose building time is known */
+    gdouble         remaining_secs;     /**< Expected building time of the nodes not done yet */
+    gushort         cpu_num;            /**< Number of CPUs that determine the max number of packages built at the same time */
+    gint            epoll_fd;           /**< Watches the output and the exit of the make processes */
+    const gchar     *log_compress;      /**< Name of the compressor of the logs or NULL */
+    gint            log_compressor;     /**< Index of the compressor of the logs or -1 */
+    guint           log_tail;           /**< Number of lines printed when a package fails */
+    guint           slots;              /**< Max number of nodes built at the same time */
+    gboolean        adaptive;           /**< The number of slots is adjusted according to the system pressure */
+    guint           slots_min;          /**< Min number of slots when adaptive */
+    guint           slots_max;          /**< Max number of slots when adaptive */
+    guint           slots_changes;      /**< Number of times the number of slots was adjusted */
+    gboolean        *slot_used;         /**< Indicates which slots are building a node */
+    guint           slot_used_len;      /**< Number of elements of slot_used: the max number of slots */
+    gint64          adapt_next_usecs;   /**< Monotonic time of the next sample of the system pressure */
+    gint64          mem_budget_kb;      /**< Max expected memory of the running nodes or 0 if unlimited */
+    gint64          mem_running_kb;     /**< Expected memory of the running nodes */
+    guint           oom_requeued;       /**< Number of builds started again after being killed by the OOM killer */
+    guint           slots_oom_max;      /**< Max number of slots after a build was killed by the OOM killer or 0 */
+    guint           prefetch_max;       /**< Max number of prefetch processes at the same time or 0 if disabled */
+    gboolean        prefetch_extract;   /**< The prefetched sources are extracted too */
+    guint           *prefetch_queue;    /**< Ids of the nodes whose sources are prefetched, in critical path order */
+    guint           prefetch_len;       /**< Number of nodes in the prefetch queue */
+    guint           prefetch_first;     /**< First position of the prefetch queue that wasn't handled yet */
+    guint           prefetch_running;   /**< Number of prefetch processes running */
+    guint           prefetch_done;      /**< Number of nodes whose sources were prefetched */
+    guint           prefetch_failed;    /**< Number of prefetch processes that failed */
+    gboolean        prefetch_stopped;   /**< The running prefetch processes were killed after an error */
+    guint           jobs;               /**< Total number of jobs of the jobserver or 0 if disabled */
+    gint            jobserver_fds[2];   /**< Jobserver pipe inherited by the make processes */
+    gint            jobserver_rd;       /**< Non-blocking read end of the jobserver pipe used by pbuilder */
+    gboolean        jobserver_implicit_free;    /**< pbuilder's implicit token is not used by any package */
     GTimer          *timer;             /**< Timer needed to measure the graph's building time */
     gdouble         elapsed_secs;       /**< Time required to build the whole graph */
     gboolean        build_error;        /**< An error occurred while building */
+    gboolean        keep_going;         /**< The nodes that don't depend on a failed node are built after an error */
+    guint           nodes_failed;       /**< Number of nodes that failed when keep_going is set */
+    guint           nodes_blocked;      /**< Number of nodes not built because they depend on a failed node */
     PBEnv           env;                /**< Store the environment variables */
     GString         *br2_ext_file;      /**< File used as flag to avoid br2-external concurrent executions */
-    GMutex          nodes_mutex;        /**< Protect data accessed inside the building thread */
+    guint           nodes_running;      /**< Number of nodes being built */
+    gint            nodes_done;         /**< Number of nodes already built */
+    guint           *ready_heap;        /**< Ids of the nodes whose parents are built */
+    guint           ready_num;          /**< Number of nodes in the ready heap */
+    gint64          start_usecs;        /**< Monotonic time when the graph started to be built */
+    struct pbuilder_trace_st *trace;    /**< Timeline of the build or NULL if it's not written */
+    gint64          dispatch_total_usecs;   /**< Sum of the ready-to-running latencies */
+    gint64          dispatch_max_usecs; /**< Max ready-to-running latency */
+    guint           dispatch_count;     /**< Number of nodes whose latency was measured */
 };
 
 /*PBResult    pb_finalize_single_target(PBMain, const gchar *);*/
-PBNode      pb_node_find_by_name(GList *, gchar *);
-gint        pb_node_name_exists(gconstpointer, gconstpointer);
-void        pb_th_wait_for_all_threads(PBMain);
+PBNode      pb_node_find_by_name(PBMain, const gchar *);
 gboolean    pb_node_already_built(PBNode);
+gboolean    pb_node_is_host(PBNode);
 
 #endif  /* _GRAPH_COMMON_H_ */
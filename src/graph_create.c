@@ -9,65 +9,90 @@
 
 #include "graph_create.h"
 
-void pb_node_free(gpointer data)
+void pb_graph_print(PBMain pg, PBNode node)
 {
-    PBNode node = data;
-
-    if (node->name)
-        g_string_free(node->name, TRUE);
-
-    if (node->version)
-        g_string_free(node->version, TRUE);
-
-    if (node->parents_str)
-        g_strfreev(node->parents_str);
-
-    if (node->children)
-        g_list_free(node->children);
-
-    if (node->parents)
-        g_list_free(node->parents);
-
-    g_free(node);
-}
-
-void pb_graph_print_node_name(gpointer data, gpointer user_data)
-{
-    PBNode  node = data;
-    printf("%s ", node->name->str);
-}
-
-void pb_graph_print(gpointer data, gpointer user_data)
-{
-    PBNode node = data;
+    guint   i;
 
     if (!node)
         return;
 
-    printf("Package: %s%s%s\n", C_GREEN, node->name->str, C_NORMAL);
-    if (node->version->len > 0)
-        printf("\tVersion: %s\n", node->version->str);
+    printf("Package: %s%s%s\n", C_GREEN, node->name, C_NORMAL);
+    if (node->version[0] != '\0')
+        printf("\tVersion: %s\n", node->version);
     else
         printf("\tVersion: -\n");
+    if (node->type[0] != '\0')
+        printf("\tType: %s%s%s%s%s%s\n", node->type,
+            (node->build_system[0] != '\0') ? ", " : "", node->build_system,
+            (node->install & PB_INSTALL_TARGET) ? ", installs to target" : "",
+            (node->install & PB_INSTALL_STAGING) ? ", installs to staging" : "",
+            (node->install & PB_INSTALL_IMAGES) ? ", installs to images" : "");
+    if (node->steps)
+        printf("\tStep of: %s\n", node->package);
     printf("\tPriority: %d\n", node->priority);
+    printf("\tExpected time: %.3f secs (%.3f secs to the end of the graph)\n", node->weight_secs, node->cp_secs);
     printf("\tParents: ");
-    g_list_foreach(node->parents, pb_graph_print_node_name, NULL);
+    for (i = pg->parents_off[node->id]; i < pg->parents_off[node->id + 1]; i++)
+        printf("%s ", pg->nodes[pg->parents[i]].name);
     printf("\n\tChildren: ");
-    g_list_foreach(node->children, pb_graph_print_node_name, NULL);
+    for (i = pg->children_off[node->id]; i < pg->children_off[node->id + 1]; i++)
+        printf("%s ", pg->nodes[pg->children[i]].name);
     printf("\n");
 }
 
-static gint pb_graph_order_by_priority(gconstpointer a, gconstpointer b)
+/**
+ * @brief Sort the node ids by priority. Priorities are small integers, so a counting sort
+ * is used. It keeps the creation order of the nodes that have the same priority.
+ * @param pg Main struct
+ */
+void pb_graph_order_by_priority(PBMain pg)
 {
-    PBNode node_a = (PBNode)a;
-    PBNode node_b = (PBNode)b;
+    guint   *count,
+            max_prio = 0,
+            i;
 
-    if (node_a->priority < node_b->priority)
-        return -1;
-    else if (node_a->priority > node_b->priority)
-        return 1;
-    else
-        return 0;
+    for (i = 0; i < pg->nodes_num; i++)
+        max_prio = MAX(max_prio, pg->nodes[i].priority);
+
+    count = g_new0(guint, max_prio + 2);
+
+    for (i = 0; i < pg->nodes_num; i++)
+        count[pg->nodes[i].priority + 1]++;
+
+    for (i = 1; i <= max_prio + 1; i++)
+        count[i] += count[i - 1];
+
+    g_free(pg->sorted);
+    pg->sorted = g_new(guint, pg->nodes_num);
+
+    for (i = 0; i < pg->nodes_num; i++)
+        pg->sorted[count[pg->nodes[i].priority]++] = i;
+
+    g_free(count);
+}
+
+/**
+ * @brief Calculate for each node the expected time of the longest path from it to a leaf,
+ * that is, its own expected building time plus the longest one among its children.
+ * The nodes are visited in reverse priority order, so the children are always calculated first.
+ * @param pg Main struct
+ */
+void pb_graph_calc_critical_path(PBMain pg)
+{
+    gint    k;
+    guint   i;
+
+    for (k = pg->nodes_num - 1; k >= 0; k--) {
+        PBNode  node = &pg->nodes[pg->sorted[k]];
+        gdouble longest = 0;
+
+        for (i = pg->children_off[node->id]; i < pg->children_off[node->id + 1]; i++)
+            longest = MAX(longest, pg->nodes[pg->children[i]].cp_secs);
+
+        node->cp_secs = node->weight_secs + longest;
+    }
+
+    pb_debug(1, DBG_CREATE, "Expected length of the critical path: %.3f secs\n", pg->nodes[0].cp_secs);
 }
 
 static PBResult pb_child_set_status_ready(PBNode node)
@@ -77,366 +102,595 @@ static PBResult pb_child_set_status_ready(PBNode node)
 
     node->status = PB_STATUS_READY;
 
-    pb_debug(2, DBG_CREATE, "Node '%s' has build priority:    %d\n", node->name->str, node->priority);
+    pb_debug(2, DBG_CREATE, "Node '%s' has build priority:    %d\n", node->name, node->priority);
 
     return PB_OK;
 }
 
-static void pb_child_set_prio(gpointer data, gpointer user_data)
+/**
+ * @brief Get the closest common dominator of two nodes. Both positions are indexes
+ * in the topological order, so a dominator always has a lower index than the node it dominates.
+ * @param idom Array with the immediate dominator of each position in the topological order
+ * @param a Position of the first node
+ * @param b Position of the second node
+ * @return The position of the common dominator
+ */
+static guint pb_graph_dominators_intersect(guint *idom, guint a, guint b)
 {
-    PBNode  parent = data;
-    PBNode  child = user_data;
-
-    if (parent->priority >= child->priority) {
-        child->priority = parent->priority + 1;
+    while (a != b) {
+        while (a > b)
+            a = idom[a];
+        while (b > a)
+            b = idom[b];
     }
+
+    return a;
 }
 
-static void pb_are_parents_ready(gpointer data, gpointer user_data)
+/**
+ * @brief Give a priority of their own to the nodes that dominate a large part of the graph,
+ * that is, nodes through which all the paths from the root to many other nodes go,
+ * such as the C library. Every other node with the same or higher priority is moved one priority
+ * down, so the dominator node is always built before the nodes that had its same priority.
+ * This replaces the former special case for uclibc.
+ * @param pg Main struct
+ * @param order The node ids sorted topologically, the root first
+ */
+static void pb_graph_isolate_barrier_nodes(PBMain pg, guint *order)
 {
-    PBNode      parent = data;
-    gboolean    *parent_already_built = user_data;
+    guint       *pos,
+                *idom,
+                *dominated,
+                *level_nodes,
+                *level_barriers,
+                *shift,
+                n = pg->nodes_num,
+                i,
+                j,
+                max_prio = 0;
+    gboolean    *barrier;
+
+    if (n < 3)
+        return;
 
-    if (parent->status < PB_STATUS_READY)
-        *parent_already_built = FALSE;
-}
+    pos = g_new0(guint, n);
+    idom = g_new0(guint, n);
+    dominated = g_new0(guint, n);
+    barrier = g_new0(gboolean, n);
 
-static void pb_child_calc_prio(gpointer data, gpointer user_data)
-{
-    PBNode      child = data;
-    gboolean    all_parents_built = TRUE;
+    for (i = 0; i < n; i++)
+        pos[order[i]] = i;
+
+    /* Immediate dominators. The parents of a node are always before it in the topological order */
+    for (i = 1; i < n; i++) {
+        gint    d = -1;
 
-    g_list_foreach(child->parents, pb_are_parents_ready, &all_parents_built);
+        for (j = pg->parents_off[order[i]]; j < pg->parents_off[order[i] + 1]; j++) {
+            guint   p = pos[pg->parents[j]];
 
-    if (all_parents_built) {
-        g_list_foreach(child->parents, pb_child_set_prio, child);
-        pb_child_set_status_ready(child);
+            d = (d < 0) ? (gint)p : (gint)pb_graph_dominators_intersect(idom, d, p);
+        }
+        idom[i] = (d < 0) ? 0 : d;
     }
-}
 
-static void pb_grandson_calc_prio(gpointer data, gpointer user_data)
-{
-    PBNode      child = data;
+    /* Number of nodes dominated by each node */
+    for (i = n - 1; i > 0; i--)
+        dominated[idom[i]] += dominated[i] + 1;
+
+    for (i = 0; i < n; i++)
+        max_prio = MAX(max_prio, pg->nodes[i].priority);
+
+    level_nodes = g_new0(guint, max_prio + 1);
+    level_barriers = g_new0(guint, max_prio + 1);
+    shift = g_new0(guint, max_prio + 1);
+
+    for (i = 1; i < n; i++) {
+        PBNode  node = &pg->nodes[order[i]];
+
+        level_nodes[node->priority]++;
+        if (dominated[i] * 100 >= (n - 1) * PB_PRIO_BARRIER_MIN_PCT) {
+            barrier[i] = TRUE;
+            level_barriers[node->priority]++;
+            pb_debug(1, DBG_CREATE, "Package '%s' dominates %u packages\n", node->name, dominated[i]);
+        }
+    }
+
+    /* shift[l] is the number of levels lower than l that have to be split */
+    for (i = 1; i <= max_prio; i++)
+        shift[i] = shift[i - 1] + (level_barriers[i - 1] && level_nodes[i - 1] > level_barriers[i - 1]);
+
+    for (i = 1; i < n; i++) {
+        PBNode  node = &pg->nodes[order[i]];
+        guint   prio = node->priority;
 
-    pb_node_calc_prio(child);
+        node->priority += shift[prio];
+        if (!barrier[i] && level_barriers[prio] && level_nodes[prio] > level_barriers[prio])
+            node->priority++;
+
+        if (node->priority != prio)
+            pb_debug(2, DBG_CREATE, "Recalculating '%s' priority to %d\n", node->name, node->priority);
+    }
+
+    g_free(shift);
+    g_free(level_barriers);
+    g_free(level_nodes);
+    g_free(barrier);
+    g_free(dominated);
+    g_free(idom);
+    g_free(pos);
 }
 
 /**
- * @brief Move recursively through the graph using the children list and
- * calculate each node priority using its parents list
- * @param node A child node
+ * @brief Report the packages that could not be sorted because they are part of a
+ * dependency cycle or depend on one. One of the cycles is printed following the parents
+ * of an unsorted node until a node is repeated.
+ * @param pg Main struct
+ * @param pending Number of unsorted parents of each node
+ * @param unsorted Number of unsorted nodes
  */
-PBResult pb_node_calc_prio(PBNode node)
+static void pb_graph_report_cycle(PBMain pg, guint *pending, guint unsorted)
 {
-    if (!node)
-        return PB_FAIL;
+    GArray      *path;
+    GString     *cycle;
+    gint        *step;
+    gint        node = -1;
+    guint       i;
+
+    pb_log(PB_ERR, "Dependency cycle detected. %u packages can't be built:\n", unsorted);
+
+    for (i = 0; i < pg->nodes_num; i++) {
+        if (pending[i] > 0) {
+            pb_debug(1, DBG_CREATE, "\t%s\n", pg->nodes[i].name);
+            if (node < 0)
+                node = i;
+        }
+    }
 
-    pb_debug(3, DBG_CREATE, "%s(): Processing '%s'\n", __func__, node->name->str);
+    if (node < 0)
+        return;
 
-    g_list_foreach(node->children, pb_child_calc_prio, node);
+    step = g_new(gint, pg->nodes_num);
+    for (i = 0; i < pg->nodes_num; i++)
+        step[i] = -1;
 
-    g_list_foreach(node->children, pb_grandson_calc_prio, node);
+    /* Every unsorted node has at least one unsorted parent, so this walk always finds a cycle */
+    path = g_array_new(FALSE, FALSE, sizeof(guint));
+    while (step[node] < 0) {
+        step[node] = path->len;
+        g_array_append_val(path, node);
 
-    return PB_OK;
+        for (i = pg->parents_off[node]; i < pg->parents_off[node + 1]; i++) {
+            if (pending[pg->parents[i]] > 0) {
+                node = pg->parents[i];
+                break;
+            }
+        }
+    }
+
+    cycle = g_string_new(NULL);
+    for (i = step[node]; i < path->len; i++)
+        g_string_append_printf(cycle, "%s -> ", pg->nodes[g_array_index(path, guint, i)].name);
+    g_string_append(cycle, pg->nodes[node].name);
+
+    pb_log(PB_ERR, "Cycle (each package depends on the next one): %s\n", cycle->str);
+
+    g_string_free(cycle, TRUE);
+    g_array_free(path, TRUE);
+    g_free(step);
 }
 
-static PBResult pb_graph_calc_nodes_priority(GList *graph)
+/**
+ * @brief Sort the graph topologically (Kahn's algorithm) and give each node a priority
+ * that is one more than the highest priority of its parents. Each node and edge is
+ * visited only once. The nodes whose parents have all been sorted are set as ready.
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL if the graph contains a cycle
+ */
+PBResult pb_graph_calc_nodes_priority(PBMain pg)
 {
-    GList       *list;
-    PBNode      node;
-    gshort      prio = -1;
-    gboolean    same_prio = FALSE;
+    guint       *order,
+                *pending,
+                head = 0,
+                tail = 0,
+                i;
 
-    if (!graph)
+    if (!pg || !pg->nodes)
         return PB_FAIL;
 
-    pb_log(PB_INFO, "Calculating building priorities. This may take a while...\n");
+    pb_log(PB_INFO, "Calculating building priorities...\n");
 
-#if 1
-    if (pb_node_calc_prio(graph->data) != PB_OK) {
-        pb_log(PB_ERR, "Failed to build packages in the graph");
-        return PB_FAIL;
-    }
-#else
-    g_list_foreach(graph, pb_node_calc_prio, NULL);
-#endif
-
-#if 1
-    /* TODO: Fix uclibc deps so this can be removed? */
-    for (list = graph; list; list = list->next) {
-        node = list->data;
-        if (!strcmp(node->name->str, "uclibc")) {
-            prio = node->priority;
-            printf("uclibc priority is %d\n", node->priority);
-            break;
-        }
+    order = g_new(guint, pg->nodes_num);
+    pending = g_new0(guint, pg->nodes_num);
+
+    for (i = 0; i < pg->nodes_num; i++) {
+        pending[i] = pg->parents_off[i + 1] - pg->parents_off[i];
+        if (!pending[i])
+            order[tail++] = i;
     }
 
-    if (prio < 0)
-        return PB_OK;
+    while (head < tail) {
+        PBNode  node = &pg->nodes[order[head++]];
 
-    /* Is there another package with the same priority? */
-    for (list = graph; list; list = list->next) {
-        node = list->data;
-        if (node->priority == prio && strcmp(node->name->str, "uclibc")) {
-            pb_debug(1, DBG_CREATE, "Package '%s' has the same priority %d\n",
-                node->name->str, node->priority);
-            same_prio = TRUE;
-            break;
-        }
-    }
+        pb_debug(3, DBG_CREATE, "%s(): Processing '%s'\n", __func__, node->name);
 
-    if (same_prio == FALSE)
-        return PB_OK;
+        for (i = pg->children_off[node->id]; i < pg->children_off[node->id + 1]; i++) {
+            PBNode  child = &pg->nodes[pg->children[i]];
+
+            if (child->priority <= node->priority)
+                child->priority = node->priority + 1;
 
-    for (list = graph; list; list = list->next) {
-        node = list->data;
-        if (node->priority >= prio) {
-            if (strcmp(node->name->str, "uclibc")) {
-                node->priority++;
-                pb_debug(2, DBG_CREATE, "Recalculating '%s' priority to %d\n",
-                    node->name->str, node->priority);
+            if (--pending[child->id] == 0) {
+                order[tail++] = child->id;
+                pb_child_set_status_ready(child);
             }
         }
     }
-#endif
+
+    if (tail < pg->nodes_num) {
+        pb_graph_report_cycle(pg, pending, pg->nodes_num - tail);
+        g_free(pending);
+        g_free(order);
+        return PB_FAIL;
+    }
+
+    pb_graph_isolate_barrier_nodes(pg, order);
+
+    g_free(pending);
+    g_free(order);
 
     return PB_OK;
 }
 
-static void pb_node_link_single_parent_to_children(gpointer data, gpointer user_data)
+/**
+ * @brief Get the id of a node using the names index
+ * @param pbg Main struct
+ * @param name The package name
+ * @param id Where the id is stored if the node is found
+ * @return TRUE if the node exists, FALSE otherwise
+ */
+static gboolean pb_node_lookup_id(PBMain pbg, const gchar *name, guint *id)
 {
-    PBNode      node = data,
-                child_node;
-    GList       *child_element;
-    PBNodeName  name_in_graph = user_data;
+    gpointer    value = g_hash_table_lookup(pbg->nodes_by_name, name);
 
-    pb_debug(2, DBG_CREATE, "Linking parent %s to child %s\n", node->name->str, name_in_graph->name->str);
+    if (!value)
+        return FALSE;
 
-    child_element = g_list_find_custom(node->children,
-        name_in_graph->name->str,
-        (GCompareFunc)pb_node_name_exists);
-    if (child_element)
-        return;
+    *id = GPOINTER_TO_UINT(value) - 1;
 
-    child_element = g_list_find_custom(name_in_graph->graph,
-        name_in_graph->name->str,
-        (GCompareFunc)pb_node_name_exists);
-    if (!child_element)
-        return;
+    return TRUE;
+}
+
+/**
+ * @brief Resolve the parent names of each node and store the edges of the graph in two
+ * CSR (compressed sparse row) arrays: the parents of node i are parents[parents_off[i]]
+ * to parents[parents_off[i + 1] - 1], and the same for the children.
+ * Nodes without known parents get the root 'ALL' as parent.
+ * @param pbg Main struct
+ * @param deps Parent names of all the nodes, interned in the names arena
+ * @param deps_off Offset in deps of the parent names of each node. It has nodes_num + 1 elements
+ */
+static void pb_graph_link_nodes(PBMain pbg, GPtrArray *deps, GArray *deps_off)
+{
+    GArray      *parents;
+    guint       *mark,
+                *fill,
+                n = pbg->nodes_num,
+                parent,
+                i,
+                j;
+
+    parents = g_array_sized_new(FALSE, FALSE, sizeof(guint), deps->len + n);
+    pbg->parents_off = g_new(guint, n + 1);
+
+    /* mark[p] is i + 1 when p was already added as parent of i */
+    mark = g_new0(guint, n);
+
+    pb_debug(2, DBG_CREATE, "\n-----\nLink children to parents\n-----\n");
+
+    for (i = 0; i < n; i++) {
+        pbg->parents_off[i] = parents->len;
+
+        for (j = g_array_index(deps_off, guint, i); j < g_array_index(deps_off, guint, i + 1); j++) {
+            if (!pb_node_lookup_id(pbg, g_ptr_array_index(deps, j), &parent) || mark[parent] == i + 1)
+                continue;
+
+            pb_debug(2, DBG_CREATE, "\tAdding %s as parent of %s\n", pbg->nodes[parent].name, pbg->nodes[i].name);
+            mark[parent] = i + 1;
+            g_array_append_val(parents, parent);
+        }
 
-    child_node = (PBNode)child_element->data;
-    node->children = g_list_append(node->children, child_node);
-    return;
+        /* Set the root parent 'ALL' to all orphan nodes */
+        if (i > 0 && parents->len == pbg->parents_off[i]) {
+            parent = 0;
+            g_array_append_val(parents, parent);
+        }
+    }
+
+    pbg->parents_off[n] = parents->len;
+    pbg->parents = (guint *)(gpointer)g_array_free(parents, FALSE);
+
+    g_free(mark);
+
+    /* Children: count them, turn the counts into offsets and fill them in node order */
+    pb_debug(2, DBG_CREATE, "\n-----\nLink parents to children\n-----\n");
+
+    pbg->children_off = g_new0(guint, n + 1);
+    pbg->children = g_new(guint, pbg->parents_off[n]);
+
+    for (i = 0; i < pbg->parents_off[n]; i++)
+        pbg->children_off[pbg->parents[i] + 1]++;
+
+    for (i = 1; i <= n; i++)
+        pbg->children_off[i] += pbg->children_off[i - 1];
+
+    fill = g_new(guint, n);
+    memcpy(fill, pbg->children_off, n * sizeof(guint));
+
+    for (i = 0; i < n; i++)
+        for (j = pbg->parents_off[i]; j < pbg->parents_off[i + 1]; j++)
+            pbg->children[fill[pbg->parents[j]]++] = i;
+
+    g_free(fill);
 }
 
 /**
- * @brief For each node in main graph and for each parent of those nodes,
- * add to the list of children of each parent the node in the main graph.
- * The above two functions do the searching and linking.
- * @param data One node in the main graph
- * @param user_data The main graph
+ * @brief Prepare the main struct and the builder for adding nodes and create the root 'ALL'
+ * @param b The graph builder
+ * @param pbg Main struct
+ * @param names_size Expected size of all the interned names and versions
  */
-void static pb_node_link_parents_to_children(gpointer data, gpointer user_data)
+void pb_graph_builder_init(PBGraphBuilder b, PBMain pbg, gsize names_size)
 {
-    PBNode      node = data;
-    PBNodeName  name_in_graph;
+    b->pg = pbg;
 
-    name_in_graph = g_new0(struct pbuilder_node_name_in_graph_st, 1);
-    name_in_graph->graph = (GList *)user_data;
-    name_in_graph->name = node->name;
+    pbg->names = g_string_chunk_new(names_size + BUFF_1K);
+    pbg->nodes_by_name = g_hash_table_new(g_str_hash, g_str_equal);
 
-    g_list_foreach(node->parents, pb_node_link_single_parent_to_children, name_in_graph);
+    b->nodes = g_array_new(FALSE, TRUE, sizeof(struct pbuilder_node_st));
+    b->deps = g_ptr_array_new();
+    b->deps_off = g_array_new(FALSE, FALSE, sizeof(guint));
 
-    g_free(name_in_graph);
+    /* Create graph's root node */
+    pb_graph_builder_add_node(b, "ALL", "");
 }
 
 /**
- * @brief Add to the list of parents of the current node the node of a parent
- * once the parent's name has been found in the array of strings
- * (this array contains the names of the parent packages)
- * @param data The node to which its parents must be linked
- * @param user_data The main graph
+ * @brief Create a single node and append it to the nodes array. Each node represent a package.
+ * Its name and version are interned in the names arena and the node is added to the
+ * names index of the main struct. Its parents are added next with pb_graph_builder_add_parent().
+ * @param b The graph builder
+ * @param name The package name
+ * @param version The package version or an empty string
+ * @return The new node, valid until the next node is added, or NULL if it already exists
  */
-static void pb_node_link_children_to_parents(gpointer data, gpointer user_data)
+PBNode pb_graph_builder_add_node(PBGraphBuilder b, const gchar *name, const gchar *version)
 {
-    GList       *graph = user_data,
-                *parent_element;
-    PBNode      node = data,
-                parent_node;
-    gchar       **p;
+    struct pbuilder_node_st node = { 0 };
+    PBMain      pbg = b->pg;
+    guint       id;
 
-    if (!node->parents_str)
-        return;
+    /* Check if node already exists */
+    if (pb_node_lookup_id(pbg, name, &id))
+        return NULL;
 
-    pb_debug(2, DBG_CREATE, "Linking parents of %s\n", node->name->str);
+    /* Set node name */
+    node.id = b->nodes->len;
+    node.name = g_string_chunk_insert_const(pbg->names, name);
 
-    for (p = node->parents_str; *p != NULL; p++) {
-        parent_element = g_list_find_custom(graph, *p, (GCompareFunc)pb_node_name_exists);
-        if (!parent_element)
-            continue;
+    if (!g_strcmp0(node.name, "ALL"))
+        node.status = PB_STATUS_DONE;
+    else
+        node.status = PB_STATUS_PENDING;
 
-        parent_node = (PBNode)parent_element->data;
-        if (parent_node) {
-            /*if (!g_ptr_array_find(node->parents, parent_node, NULL)) {*/
-            if (!g_list_find(node->parents, parent_node)) {
-                pb_debug(2, DBG_CREATE, "\tAdding %s as parent of %s\n",
-                    parent_node->name->str, node->name->str);
-                node->parents = g_list_append(node->parents, parent_node);
-            }
-        }
-    }
+    /* Set node version */
+    node.version = g_string_chunk_insert_const(pbg->names, version ? version : "");
+    node.type = node.build_system = "";
+    node.package = node.name;
 
-    /* Set the root parent 'ALL' to all orphan nodes */
-    if (!node->parents) {
-        parent_element = g_list_find_custom(graph, "ALL", (GCompareFunc)pb_node_name_exists);
-        parent_node = (PBNode)parent_element->data;
-        node->parents = g_list_append(node->parents, parent_node);
-    }
+    node.pg = pbg;
+
+    /* Set node parent list */
+    g_array_append_val(b->deps_off, b->deps->len);
+
+    g_array_append_val(b->nodes, node);
+    g_hash_table_insert(pbg->nodes_by_name, (gpointer)node.name, GUINT_TO_POINTER(node.id + 1));
+
+    pb_debug(2, DBG_CREATE, "\tNode created: %s\n", node.name);
+
+    return &g_array_index(b->nodes, struct pbuilder_node_st, node.id);
 }
 
 /**
- * @brief Create a single node and attach it to the graph. Each node represent a package.
- * Some info is calculated later and it's parents and children are linked later.
- * @param pbg Main struct
- * @param graph The graph
- * @param node_info The node name
- * @param parents_str An array with the names of the node parents
- * @return The node
+ * @brief Add a parent to the last node created. Parents and children are
+ * linked once all the nodes exist, so the parent doesn't have to exist yet.
+ * @param b The graph builder
+ * @param name The parent name
  */
-static GList * pb_node_create(PBMain pbg, GList *graph, gchar **node_info)
+void pb_graph_builder_add_parent(PBGraphBuilder b, const gchar *name)
 {
-    PBNode      node;
-    gchar       *node_name,
-                *node_ver,
-                **p,
-                **parents_str = NULL,
-                *parent_list;
+    pb_debug(2, DBG_CREATE, "\tParent: %s\n", name);
+    g_ptr_array_add(b->deps, g_string_chunk_insert_const(b->pg->names, name));
+}
 
-    if (!pbg || !node_info)
-        return graph;
+/**
+ * @brief Move the nodes to the main struct and link them to their parents and children
+ * @param b The graph builder
+ * @param ret PB_OK if all the nodes were added, PB_FAIL otherwise
+ * @return ret
+ */
+PBResult pb_graph_builder_finish(PBGraphBuilder b, PBResult ret)
+{
+    PBMain      pbg = b->pg;
 
-    node_name = *node_info;
-    node_ver = *(node_info + 1);
-    parent_list = *(node_info + 2);
+    g_array_append_val(b->deps_off, b->deps->len);
 
-    g_strchomp(node_name);
+    pbg->nodes_num = b->nodes->len;
+    pbg->nodes = (PBNode)(gpointer)g_array_free(b->nodes, FALSE);
 
-    /* Check if node already exists */
-    if (g_list_find_custom(graph, node_name, (GCompareFunc)pb_node_name_exists)) {
-        return graph;
-    }
+    if (ret == PB_OK)
+        pb_graph_link_nodes(pbg, b->deps, b->deps_off);
 
-    pb_debug(2, DBG_CREATE, "Parsing %s -> ", node_name);
+    g_ptr_array_free(b->deps, TRUE);
+    g_array_free(b->deps_off, TRUE);
 
-    /* Set node name */
-    node = g_new0(struct pbuilder_node_st, 1);
+    return ret;
+}
 
-    node->name = g_string_new(NULL);
-    g_string_printf(node->name, "%s", node_name);
+static gboolean pb_deps_is_space(gchar c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-    if (!g_strcmp0(node->name->str, "ALL"))
-        node->status = PB_STATUS_DONE;
-    else 
-        node->status = PB_STATUS_PENDING;
+/**
+ * @brief Strip the white spaces around a token of a line and terminate it in place
+ * @param start First char of the token
+ * @param end Char after the token. It's overwritten with a NUL
+ * @return The stripped token
+ */
+static gchar * pb_deps_strip(gchar *start, gchar *end)
+{
+    while (start < end && pb_deps_is_space(*start))
+        start++;
+    while (end > start && pb_deps_is_space(*(end - 1)))
+        end--;
 
-    /* Set node version */
-    if (node_ver && strlen(node_ver) > 0) {
-        g_strstrip(node_ver);
-        node->version = g_string_new(NULL);
-        g_string_printf(node->version, "%s", node_ver);
+    *end = '\0';
+
+    return start;
+}
+
+/**
+ * @brief Create a node from a line of the dependencies file: "<name>:<version>:<parents>",
+ * where the version may be empty and the parents are separated by spaces.
+ * The line is tokenized in place, so it's modified.
+ * @param b The graph builder
+ * @param line The line, without the newline
+ * @param end Char after the line. It's overwritten with a NUL
+ * @param line_num Line number used in the error messages
+ * @return PB_OK if successful, PB_FAIL if the line is malformed
+ */
+static PBResult pb_node_create(PBGraphBuilder b, gchar *line, gchar *end, guint line_num)
+{
+    gchar       *node_name,
+                *node_ver,
+                *parent,
+                *colon1,
+                *colon2,
+                *p;
+
+    if ((colon1 = memchr(line, ':', end - line)) == NULL) {
+        pb_log(PB_ERR, "%s:%u: Missing ':' after the package name\n", deps_file, line_num);
+        return PB_FAIL;
     }
-    else {
-        node->version = g_string_new(NULL);
+
+    if ((colon2 = memchr(colon1 + 1, ':', end - colon1 - 1)) == NULL) {
+        pb_log(PB_ERR, "%s:%u: Missing ':' after the package version\n", deps_file, line_num);
+        return PB_FAIL;
     }
 
-    /* Set node parent list */
-    if (parent_list && strlen(parent_list) > 0) {
-        g_strchug(parent_list);
-        g_strchomp(parent_list);
-
-        parents_str = g_strsplit(parent_list, " ", 0);
-        for (p = parents_str; *p != NULL; p++)
-            pb_debug(2, DBG_CREATE, "%s ", *p);
-        pb_debug(2, DBG_CREATE, "\n");
+    node_name = pb_deps_strip(line, colon1);
+    node_ver = pb_deps_strip(colon1 + 1, colon2);
+
+    if (*node_name == '\0') {
+        pb_log(PB_ERR, "%s:%u: Missing package name\n", deps_file, line_num);
+        return PB_FAIL;
+    }
+
+    for (p = node_name; *p; p++) {
+        if (pb_deps_is_space(*p)) {
+            pb_log(PB_ERR, "%s:%u: Invalid package name '%s'\n", deps_file, line_num, node_name);
+            return PB_FAIL;
+        }
     }
 
-    node->parents_str = parents_str;
-    node->parents = NULL;
-    node->children = NULL;
-    node->pg = pbg;
+    pb_debug(2, DBG_CREATE, "Parsing %s\n", node_name);
+
+    if (!pb_graph_builder_add_node(b, node_name, node_ver))
+        return PB_OK;
+
+    *end = '\0';
 
-    graph = g_list_append(graph, node);
+    for (p = colon2 + 1; p < end; ) {
+        while (p < end && pb_deps_is_space(*p))
+            p++;
+        if (p == end)
+            break;
 
-    pb_debug(2, DBG_CREATE, "\tNode created: %s\n", node->name->str);
+        parent = p;
+        while (p < end && !pb_deps_is_space(*p))
+            p++;
+        *p++ = '\0';
 
-    return graph;
+        pb_graph_builder_add_parent(b, parent);
+    }
+
+    return PB_OK;
 }
 
 /**
  * @brief For each package in the dependencies file, create a node of the graph
  * that represents a package and link it to its parents and children.
+ * The file is mapped in memory as a private copy and its lines, whatever their length,
+ * are tokenized in place. Empty lines and lines that start with '#' are skipped.
  * @param pbg Main struct
  * @return PB_OK if successful, PB_FAIL otherwise
  */
-static PBResult pb_graph_create_from_deps_file(PBMain pbg)
+PBResult pb_graph_create_from_deps_file(PBMain pbg)
 {
-    char            line[BUFF_4K];
-    FILE            *fd;
-    GList           *graph = NULL;
-    gchar           *root_node[] = {"ALL", "", ""};
+    struct pbuilder_graph_builder_st b;
+    GMappedFile     *map;
+    GError          *error = NULL;
+    gchar           *data,
+                    *line,
+                    *end,
+                    *last = NULL,
+                    *p;
+    gsize           len;
+    guint           line_num = 0;
+    PBResult        ret = PB_OK;
 
     pb_debug(2, DBG_CREATE, "-----\nCreate each single node\n-----\n");
 
-    /* Create graph's root node */
-    if ((graph = pb_node_create(pbg, graph, root_node)) == NULL) {
-        pb_log(PB_ERR, "%s(): Failed to create root node", __func__);
+    if ((map = g_mapped_file_new(deps_file, TRUE, &error)) == NULL) {
+        pb_log(PB_ERR, "%s(): %s", __func__, error->message);
+        g_error_free(error);
         return PB_FAIL;
     }
 
-    if ((fd = fopen(deps_file, "r")) == NULL) {
-        pb_log(PB_ERR, "%s(): open(): %s: %s", __func__, deps_file, strerror(errno));
-        return PB_FAIL;
-    }
-
-    memset(line, 0, BUFF_4K);
+    data = g_mapped_file_get_contents(map);
+    len = g_mapped_file_get_length(map);
 
-    while (fgets(line, BUFF_4K, fd)) {
-        gchar   **node_info;
+    /* Every interned string comes from the file, so the arena fits in a single block */
+    pb_graph_builder_init(&b, pbg, len);
 
-        if (!strncmp(line, "#", 1))
-            continue;
+    for (line = data; ret == PB_OK && line < data + len; line = end + 1) {
+        line_num++;
 
-        /* g_strsplit() doesn't return NULL */
-        node_info = g_strsplit(line, ":", 3);
-
-        /* Create new node and its parents nodes */
-        if ((graph = pb_node_create(pbg, graph, node_info)) == NULL) {
-            pb_log(PB_ERR, "%s(): Failed to create node '%s' or one of its parents", __func__, *node_info);
-            g_strfreev(node_info);
-            return PB_FAIL;
+        if ((end = memchr(line, '\n', data + len - line)) == NULL) {
+            /* The last line has no newline to be overwritten, so it's copied */
+            last = g_strndup(line, data + len - line);
+            end = last + (data + len - line);
+            line = last;
         }
 
-        g_strfreev(node_info);
-    }
+        for (p = line; p < end && pb_deps_is_space(*p); p++)
+            ;
 
-    fclose(fd);
+        if (p < end && *p != '#')
+            ret = pb_node_create(&b, line, end, line_num);
 
-    /* Link children to parents */
-    pb_debug(2, DBG_CREATE, "\n-----\nLink children to parents\n-----\n");
-    g_list_foreach(graph, pb_node_link_children_to_parents, graph);
-
-    /* Link parents to children */
-    pb_debug(2, DBG_CREATE, "\n-----\nLink parents to children\n-----\n");
-    g_list_foreach(graph, pb_node_link_parents_to_children, graph);
+        if (line == last)
+            break;
+    }
 
-    pbg->graph = graph;
+    g_free(last);
+    g_mapped_file_unref(map);
 
-    return PB_OK;
+    return pb_graph_builder_finish(&b, ret);
 }
 
 /**
- * @brief Free the main graph and free the threads pool
+ * @brief Free the main graph
  * @param pbg Main struct
  */
 void pb_graph_free(PBMain pbg)
@@ -444,47 +698,91 @@ void pb_graph_free(PBMain pbg)
     if (!pbg)
         return;
 
-    if (pbg->graph) {
-        g_list_free_full(pbg->graph, pb_node_free);
-    }
+    if (pbg->nodes_by_name)
+        g_hash_table_destroy(pbg->nodes_by_name);
 
-    if (pbg->th_pool)
-        g_thread_pool_free(pbg->th_pool, TRUE, FALSE);
+    g_free(pbg->nodes);
+    g_free(pbg->sorted);
+    g_free(pbg->ready_heap);
+    g_free(pbg->parents_off);
+    g_free(pbg->parents);
+    g_free(pbg->children_off);
+    g_free(pbg->children);
+
+    if (pbg->names)
+        g_string_chunk_free(pbg->names);
+
+    pb_graph_cache_free(pbg);
+
+    pb_history_free(pbg);
+
+    pb_jobserver_free(pbg);
+
+    pb_exec_free(pbg);
 
     g_free(pbg);
 }
 
 /**
- * @brief Create the threads pool, create the graph from the dependencies file
- * and assign a priority to each node
+ * @brief Create the graph from the dependencies file or the output of 'make show-info'
+ * and assign a priority to each node, or load it from the graph cache if the inputs didn't change
  * @param pbg Main struct
  * @return PB_OK if successful, PB_FAIL otherwise
  */
 PBResult pb_graph_create(PBMain pg)
 {
+    guint8      key[PB_GRAPH_CACHE_KEY_LEN];
+    gboolean    cacheable;
+    guint       i;
+
     if (!pg)
         return PB_FAIL;
 
-    if (pb_graph_create_from_deps_file(pg) != PB_OK) {
+    /* The output of 'make show-info' is part of the key of the cache */
+    if (!g_strcmp0(show_info, PB_SHOW_INFO_MAKE) && pb_show_info_run_make(pg) != PB_OK) {
         pb_log(PB_ERR, "Failed to create graph");
         pb_graph_free(pg);
         return PB_FAIL;
     }
 
-    if (pb_graph_calc_nodes_priority(pg->graph) != PB_OK) {
-        pb_log(PB_ERR, "Failed to build graph");
+    cacheable = (pb_graph_cache_get_key(pg, key) == PB_OK);
+
+    if (!cacheable || pb_graph_cache_load(pg, key) != PB_OK) {
+        if ((show_info ? pb_show_info_load(pg) : pb_graph_create_from_deps_file(pg)) != PB_OK ||
+                (split_steps && pb_graph_steps_split(pg) != PB_OK)) {
+            pb_log(PB_ERR, "Failed to create graph");
+            pb_graph_free(pg);
+            return PB_FAIL;
+        }
+
+        if (pb_graph_calc_nodes_priority(pg) != PB_OK) {
+            pb_log(PB_ERR, "Failed to build graph");
+            pb_graph_free(pg);
+            return PB_FAIL;
+        }
+
+        pb_graph_order_by_priority(pg);
+
+        if (cacheable)
+            pb_graph_cache_save(pg, key);
+    }
+
+    if (pb_history_load(pg) != PB_OK) {
+        pb_log(PB_ERR, "Failed to load the building time history");
         pb_graph_free(pg);
         return PB_FAIL;
     }
 
-    pg->graph = g_list_sort(pg->graph, pb_graph_order_by_priority);
+    pb_graph_calc_critical_path(pg);
+
+    pb_sched_init(pg);
 
     if (debug_level >= 1) {
         pb_debug(1, DBG_ALL, "----- Graph organization -----\n");
-        g_list_foreach(pg->graph, pb_graph_print, NULL);
+        for (i = 0; i < pg->nodes_num; i++)
+            pb_graph_print(pg, &pg->nodes[pg->sorted[i]]);
         pb_debug(1, DBG_ALL, "-----\n\n");
     }
 
     return PB_OK;
 }
-
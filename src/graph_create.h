@@ -11,22 +11,43 @@
 #define _GRAPH_CREATE_H_
 
 #include "graph_common.h"
+#include "graph_cache.h"
+#include "graph_steps.h"
+#include "history.h"
+#include "jobserver.h"
+#include "executor.h"
+#include "sched.h"
+#include "show_info.h"
 #include "utils.h"
 
-typedef struct pbuilder_node_name_in_graph_st * PBNodeName;
+/**
+ * Min percentage of the graph that a node has to dominate in order to get a priority of its own
+ */
+#define PB_PRIO_BARRIER_MIN_PCT     25
+
+typedef struct pbuilder_graph_builder_st *  PBGraphBuilder;
 
 /**
- * Aux struct used for passing parameters while linking
- * parents to children nodes during the graph creation
+ * Nodes being added to the graph. The parents of each node are stored by name
+ * and resolved once all the nodes exist.
  */
-struct pbuilder_node_name_in_graph_st
+struct pbuilder_graph_builder_st
 {
-    GList           *graph;
-    GString         *name;
+    PBMain          pg;                 /**< Main struct */
+    GArray          *nodes;             /**< The nodes created so far */
+    GPtrArray       *deps;              /**< Parent names of all the nodes, interned in the names arena */
+    GArray          *deps_off;          /**< Offset in deps of the parent names of each node */
 };
 
-
-PBResult    pb_node_calc_prio(PBNode);
+void        pb_graph_builder_init(PBGraphBuilder, PBMain, gsize);
+PBNode      pb_graph_builder_add_node(PBGraphBuilder, const gchar *, const gchar *);
+void        pb_graph_builder_add_parent(PBGraphBuilder, const gchar *);
+PBResult    pb_graph_builder_finish(PBGraphBuilder, PBResult);
+PBResult    pb_graph_create_from_deps_file(PBMain);
+PBResult    pb_graph_calc_nodes_priority(PBMain);
+void        pb_graph_order_by_priority(PBMain);
+void        pb_graph_calc_critical_path(PBMain);
+void        pb_graph_print(PBMain, PBNode);
 PBResult    pb_graph_create(PBMain);
 void        pb_graph_free(PBMain);
 
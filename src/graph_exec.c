@@ -1,7 +1,7 @@
 /**
  * @file graph_exec.c
  * @brief Functions that actually build the packages following the previously set priority
- * in parallel according to the number of specified cores/threads.
+ * in parallel according to the number of specified cores.
  *
  * Copyright (C) 2022 Pedro Aguilar <paguilar@paguilar.org>
  * Released under the terms of the GNU GPL v2.0.
@@ -9,6 +9,19 @@
  */
 
 #include "graph_common.h"
+#include "history.h"
+#include "jobserver.h"
+#include "sched.h"
+#include "adapt.h"
+#include "mem.h"
+#include "prefetch.h"
+#include "rusage.h"
+#include "steps.h"
+#include "trace.h"
+#include "executor.h"
+#include "logs.h"
+
+#include <poll.h>
 
 /**
  * @brief Execute the last targets that are not packages, but steps normally used
@@ -20,14 +33,14 @@
  */
 PBResult pb_finalize_single_target(PBMain pg, const gchar *target)
 {
-    gchar   path[BUFF_8K];
-    FILE    *fp = NULL,
-            *flog = NULL;
-    gint    ret,
-            have_logs = 0,
-			target_build_failed = 0;
-    GString *cmd,
-            *logs;
+    struct pollfd   pfd;
+    PBLog   log;
+    gchar   *log_name;
+    gint    out_fd,
+            status = 0,
+            target_build_failed = 0;
+    gssize  len;
+    pid_t   pid;
     GTimer  *timer;
     gdouble elapsed_time;
     gulong  elapsed_usecs = 0;
@@ -35,46 +48,41 @@ PBResult pb_finalize_single_target(PBMain pg, const gchar *target)
     if (!pg || !target)
         return PB_FAIL;
 
-    cmd = g_string_new(NULL);
-    if (strlen(pg->env->br2_external) > 0)
-        g_string_printf(cmd, "BR2_EXTERNAL=%s ", pg->env->br2_external);
-
-    g_string_append_printf(cmd, "make %s 2>&1", target);
-
     timer = g_timer_new();
 
-    logs = g_string_new(NULL);
-    g_string_printf(logs, "%s/pbuilder_logs/%s.log", pg->env->config_dir, target);
+    log = pb_logs_open(pg, target);
 
-    if ((flog = fopen(logs->str, "a")) != NULL)
-        have_logs = 1;
-    else
-        pb_log(PB_ERR, "%s(): fopen(): %s: %s", __func__, logs->str, strerror(errno));
-
-    fp = popen(cmd->str, "r");
-    if (fp == NULL) {
-        pb_log(PB_ERR, "Error while building '%s': %s", target, strerror(errno));
+    if (pb_exec_spawn_make(target, &pid, &out_fd) != PB_OK) {
+        pb_log(PB_ERR, "Error while building '%s'\n", target);
         target_build_failed = 1;
     }
     else {
-        while (fgets(path, sizeof(path), fp) != NULL) {
-            if (have_logs)
-                fwrite(path, sizeof(char), strlen(path), flog);
-            if (!strncmp(path, "\E[7m>>>", 7))
-                printf("%s", path);
+        pfd.fd = out_fd;
+        pfd.events = POLLIN;
+
+        while ((len = pb_logs_transfer(log, out_fd)) != 0) {
+            if (len < 0 && errno == EAGAIN)
+                poll(&pfd, 1, -1);
+            else if (len < 0 && errno != EINTR)
+                break;
         }
 
-        ret = WEXITSTATUS(pclose(fp));
-        if (ret) {
-            pb_log(PB_ERR, "Error while building '%s'!\nSee pbuilder_logs/%s.log\n", target, target);
+        close(out_fd);
+
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            log_name = pb_logs_get_name(pg, target);
+            pb_log(PB_ERR, "Error while building '%s'!\n", target);
+            pb_logs_print_tail(log, target);
+            pb_log(PB_ERR, "See %s\n", log_name);
+            g_free(log_name);
             target_build_failed = 1;
         }
     }
 
-    if (have_logs)
-        fclose(flog);
-
-    g_string_free(logs, TRUE);
+    pb_logs_close(log);
 
     g_timer_stop(timer);
     elapsed_time = g_timer_elapsed(timer, &elapsed_usecs);
@@ -84,8 +92,6 @@ PBResult pb_finalize_single_target(PBMain pg, const gchar *target)
 
     g_timer_destroy(timer);
 
-    g_string_free(cmd, TRUE);
-
     if (target_build_failed)
         return PB_FAIL;
 
@@ -93,240 +99,446 @@ PBResult pb_finalize_single_target(PBMain pg, const gchar *target)
 }
 
 /**
- * @brief The thread that builds a node. It uses a pipe to execute 'make <package>' and send all
- * its output to the logs file pbuilder_logs/<package>.logs. If there's an error, the flag build_error
- * in the main struct will be set causing the calling function, pb_graph_exec(), to halt the overall build process.
- * @param data The node to be built
- * @return NULL
+ * @brief Add a node whose parents are all built to the ready heap.
+ * @param pg Main struct
+ * @param node The node that is ready to be built
  */
-static void pb_node_build_th(gpointer data, gpointer user_data)
+static void pb_ready_heap_push(PBMain pg, PBNode node)
 {
-    PBMain      pg = (PBMain)user_data;
-    PBNode      node = (PBNode)data;
-    GString     *cmd,
-                *logs;
-    gulong      elapsed_usecs = 0;
-    gint        ret,
-                have_logs = 0,
-                pkg_build_failed = 0,
-                total_nodes_done = 0;
-    gchar       path[BUFF_8K];
-    FILE        *fp = NULL,
-                *fd = NULL;
-
-    if (!pg || !node)
-        return;
+    if (pb_sched_ready_push(pg, node, g_get_monotonic_time()))
+        pb_trace_ready(pg, node);
+}
 
-    node->timer = g_timer_new();
+/**
+ * @brief Set the number of unbuilt parents of each node and push to the ready heap
+ * the nodes whose parents are all built.
+ * @param pg Main struct
+ */
+static void pb_ready_heap_init(PBMain pg)
+{
+    guint   i,
+            j;
 
-    /* Write output to ${CONFIG_DIR}/pbuilder_logs/<package>.log */
-    logs = g_string_new(NULL);
-    g_string_printf(logs, "%s/pbuilder_logs/%s.log", pg->env->config_dir, node->name->str);
-    if ((fd = fopen(logs->str, "a")) != NULL)
-        have_logs = 1;
-    else
-        pb_log(PB_ERR, "%s(): fopen(): %s: %s", __func__, logs->str, strerror(errno));
-
-    /* Build package by calling make <package> */
-    cmd = g_string_new(NULL);
-    if (strlen(pg->env->br2_external) > 0)
-        g_string_printf(cmd, "BR2_EXTERNAL=%s ", pg->env->br2_external);
-
-    g_string_append_printf(cmd, "make %s 2>&1", node->name->str);
-
-    fp = popen(cmd->str, "r");
-    if (fp == NULL) {
-        pb_log(PB_ERR, "%s(): Pipe creation failed while building '%s': %s", __func__, node->name->str, strerror(errno));
-        pb_log(PB_ERR, "Pipe creation failed while building '%s': %s\n", node->name->str, strerror(errno));
-		/* TODO exit thread*/
-		pkg_build_failed = 1;
-	}
-    else {
-        while (fgets(path, sizeof(path), fp) != NULL) {
-            if (have_logs)
-                fwrite(path, sizeof(char), strlen(path), fd);
-            if (!strncmp(path, "\E[7m>>>", 7))
-                printf("%s", path);
+    pg->ready_heap = g_new(guint, pg->nodes_num);
+    pg->ready_num = 0;
+    pg->nodes_done = 0;
+    pg->remaining_secs = 0;
+
+    for (i = 0; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+        gint    pending = 0;
+
+        if (node->status == PB_STATUS_DONE) {
+            pg->nodes_done++;
+            continue;
         }
 
-        ret = WEXITSTATUS(pclose(fp));
-		if (ret) {
-            pb_log(PB_ERR, "Error while building '%s'!\nSee pbuilder_logs/%s.log\n", node->name->str, node->name->str);
-            pkg_build_failed = 1;
-		}
-    }
+        for (j = pg->parents_off[i]; j < pg->parents_off[i + 1]; j++)
+            if (pg->nodes[pg->parents[j]].status != PB_STATUS_DONE)
+                pending++;
 
-    if (have_logs)
-        fclose(fd);
+        node->pending_parents = pending;
+        pg->remaining_secs += node->weight_secs;
 
-    if ((node->priority == 1) || (access(pg->br2_ext_file->str, F_OK) != 0)) {
-        if ((fd = fopen(pg->br2_ext_file->str, "w")) == NULL)
-            pb_log(PB_ERR, "%s(): fopen(): %s", __func__, strerror(errno));
+        if (pending)
+            node->status = PB_STATUS_PENDING;
         else
-            fclose(fd);
+            pb_ready_heap_push(pg, node);
     }
+}
+
+/**
+ * @brief Set a node as done and push to the ready heap the children that were
+ * waiting only for this node. The children of a failed node are never released.
+ * @param pg Main struct
+ * @param node The node that was built or that was already built
+ */
+static void pb_node_set_done(PBMain pg, PBNode node)
+{
+    guint   i;
+
+    node->end_usecs = g_get_monotonic_time();
+    node->status = PB_STATUS_DONE;
+    pg->nodes_done++;
+    pg->remaining_secs -= node->weight_secs;
 
-    g_string_free(logs, TRUE);
+    if (node->build_failed)
+        return;
+
+    for (i = pg->children_off[node->id]; i < pg->children_off[node->id + 1]; i++) {
+        PBNode  child = &pg->nodes[pg->children[i]];
 
-    g_timer_stop(node->timer);
-    node->elapsed_secs = g_timer_elapsed(node->timer, &elapsed_usecs);
+        if (pg->prefetch_max && pb_node_is_host(node))
+            child->pending_host_parents--;
 
-    if (pkg_build_failed) {
-        node->pg->build_error = TRUE;
-        node->build_failed = TRUE;
+        if (--child->pending_parents == 0)
+            pb_ready_heap_push(pg, child);
     }
+}
 
-    g_timer_destroy(node->timer);
+/**
+ * @brief Set as blocked the nodes that depend directly or indirectly on a failed node, so they're
+ * never built, and remove their expected time from the remaining time of the build.
+ * Their parents can't be all built, so they're still pending.
+ * @param pg Main struct
+ * @param node The failed node
+ */
+static void pb_node_block_descendants(PBMain pg, PBNode node)
+{
+    guint   *stack,
+            num = 0,
+            id,
+            i;
 
-    g_string_free(cmd, TRUE);
+    stack = g_new(guint, pg->nodes_num);
+    stack[num++] = node->id;
 
-    node->status = PB_STATUS_DONE;
+    while (num > 0) {
+        id = stack[--num];
 
-    /* If the package was successfully built, print elapsed time and total percentage */
-    if (!pkg_build_failed) {
-        g_mutex_lock(&pg->nodes_mutex);
+        for (i = pg->children_off[id]; i < pg->children_off[id + 1]; i++) {
+            PBNode  child = &pg->nodes[pg->children[i]];
 
-        for (GList *list = pg->graph; list; list = list->next) {
-            PBNode pkg = (PBNode)list->data;
-            if (pkg->status == PB_STATUS_DONE)
-                total_nodes_done++;
+            if (child->status != PB_STATUS_PENDING)
+                continue;
+
+            pb_debug(1, DBG_EXEC, "Package '%s' is blocked by '%s'\n", child->name, node->name);
+            child->status = PB_STATUS_BLOCKED;
+            pg->nodes_blocked++;
+            pg->remaining_secs -= child->weight_secs;
+            stack[num++] = child->id;
         }
+    }
+
+    g_free(stack);
+}
 
-        pb_log(PB_INFO, "(%.2f%%) Package '%s' built in %.3f secs\n",
-            (float)total_nodes_done / (float)g_list_length(pg->graph) * 100, node->name->str, node->elapsed_secs);
+/**
+ * @brief Set a node as failed. The build stops unless keep_going is set: then only the nodes that
+ * depend on it are not built.
+ * @param pg Main struct
+ * @param node The node that failed
+ */
+static void pb_node_set_failed(PBMain pg, PBNode node)
+{
+    node->build_failed = TRUE;
 
-        g_mutex_unlock(&pg->nodes_mutex);
+    if (pg->keep_going) {
+        pg->nodes_failed++;
+        pb_node_block_descendants(pg, node);
     }
+    else
+        pg->build_error = TRUE;
+}
 
-    return;
+/**
+ * @brief Give the lowest free slot to a node that is about to be built.
+ * There's always a free slot, since no more nodes than slots are built at the same time.
+ * @param pg Main struct
+ * @param node The node
+ */
+static void pb_node_take_slot(PBMain pg, PBNode node)
+{
+    guint   i;
+
+    for (i = 0; i < pg->slot_used_len - 1 && pg->slot_used[i]; i++)
+        ;
+
+    pg->slot_used[i] = TRUE;
+    node->slot = i;
+}
+
+static void pb_node_free_slot(PBMain pg, PBNode node)
+{
+    pg->slot_used[node->slot] = FALSE;
 }
 
 /**
- * @brief Create pool of threads. Each thread builds one package at a time.
- * The size of the pool is the "cpu" command line argument or the max number
- * of available cores
- * @param pbg Main struct
- * @return PB_OK if successful, PB_FAIL otherwise
+ * @brief Add the time elapsed between a node becoming ready and its make process starting
+ * to the dispatch latency stats.
+ * @param pg Main struct
+ * @param node A node that already started building
  */
-static PBResult pb_th_init_pool(PBMain pbg)
+static void pb_node_account_dispatch_latency(PBMain pg, PBNode node)
 {
-    GError  *th_err;
+    gint64  latency;
 
-    if (!pbg)
-        return PB_FAIL;
+    if (!node->ready_usecs || node->start_usecs < node->ready_usecs)
+        return;
 
-    /* Create a non-exclusive pool */
-    pbg->th_pool = g_thread_pool_new(pb_node_build_th, pbg, pbg->cpu_num, FALSE, NULL);
-    if (!pbg->th_pool)
-        return PB_FAIL;
+    latency = node->start_usecs - node->ready_usecs;
 
-    if(g_thread_pool_set_max_threads(pbg->th_pool, pbg->cpu_num, &th_err) != TRUE) {
-        pb_log(PB_ERR, "%s(): Failed to set max number of threads for the pool", __func__);
-        g_thread_pool_free(pbg->th_pool, TRUE, FALSE);
-        return PB_FAIL;
+    pg->dispatch_total_usecs += latency;
+    if (latency > pg->dispatch_max_usecs)
+        pg->dispatch_max_usecs = latency;
+    pg->dispatch_count++;
+
+    pb_debug(2, DBG_EXEC, "Package '%s' dispatch latency: %.3f ms\n", node->name, latency / 1000.0);
+}
+
+/**
+ * @brief Handle a 'make <package>' that exited. If there's an error, the flag build_error in the main
+ * struct will be set causing pb_graph_exec() to halt the overall build process, or only the nodes that
+ * depend on it are blocked if keep_going is set, unless the build was killed by the OOM killer:
+ * then the node is pushed again to the ready heap and the number of slots is reduced.
+ * Otherwise the node is done and its children whose parents are all built become ready.
+ * @param pg Main struct
+ * @param proc The finished process
+ */
+static void pb_node_finish(PBMain pg, PBProc proc)
+{
+    PBNode      node = proc->node;
+    FILE        *fd = NULL;
+    gint        pkg_build_failed = 0;
+
+    pb_rusage_set(node, &proc->ru);
+    pb_steps_set(node, proc->log);
+    node->exit_status = WIFSIGNALED(proc->status) ? 128 + WTERMSIG(proc->status) : WEXITSTATUS(proc->status);
+    if (node->exit_status)
+        pkg_build_failed = 1;
+
+    node->elapsed_secs = (g_get_monotonic_time() - node->start_usecs) / (gdouble)G_USEC_PER_SEC;
+
+    if ((node->priority == 1) || (access(pg->br2_ext_file->str, F_OK) != 0)) {
+        if ((fd = fopen(pg->br2_ext_file->str, "w")) == NULL)
+            pb_log(PB_ERR, "%s(): fopen(): %s", __func__, strerror(errno));
+        else
+            fclose(fd);
     }
 
-    return PB_OK;
+    pb_mem_release(pg, node);
+
+    if (pkg_build_failed && node->oom_retries < PB_MEM_MAX_RETRIES &&
+            pb_mem_was_oom_killed(node, proc->status)) {
+        /* Build it again with fewer packages at the same time */
+        node->oom_retries++;
+        pg->oom_requeued++;
+        if (pg->slots > MAX(pg->slots_min, 1))
+            pg->slots--;
+        /* The adaptive controller doesn't add the slot back */
+        pg->slots_oom_max = pg->slots;
+        node->weight_rss_kb = MAX(node->weight_rss_kb, node->maxrss_kb);
+
+        pb_log(PB_WARN, "Package '%s' was killed by the OOM killer. Building it again with %u slots (retry %u of %u)\n",
+            node->name, pg->slots, node->oom_retries, PB_MEM_MAX_RETRIES);
+
+        pb_trace_finish(pg, node, TRUE);
+        pb_ready_heap_push(pg, node);
+    }
+    else {
+        if (pkg_build_failed) {
+            gchar   *log_name = pb_logs_get_name(pg, node->name);
+
+            pb_log(PB_ERR, "Error while building '%s'!\n", node->name);
+            pb_logs_print_tail(proc->log, node->name);
+            pb_log(PB_ERR, "See %s\n", log_name);
+            g_free(log_name);
+            pb_node_set_failed(pg, node);
+        }
+
+        pb_trace_finish(pg, node, FALSE);
+        pb_node_set_done(pg, node);
+    }
+
+    /* If the package was successfully built, print elapsed time, total percentage and ETA.
+     * The blocked nodes are never built, so they count as done in the percentage */
+    if (!pkg_build_failed) {
+        gdouble eta_secs = pb_history_get_eta(pg);
+        GString *eta_str = g_string_new(NULL);
+
+        if (eta_secs >= 0) {
+            GString *nice_str = elapsed_time_nice_output(eta_secs);
+            g_string_printf(eta_str, ", ETA %s", nice_str->str);
+            g_string_free(nice_str, TRUE);
+        }
+
+        pb_log(PB_INFO, "(%.2f%%%s) Package '%s' built in %.3f secs\n",
+            (float)(pg->nodes_done + pg->nodes_blocked) / (float)pg->nodes_num * 100, eta_str->str,
+            node->name, node->elapsed_secs);
+
+        g_string_free(eta_str, TRUE);
+    }
+
+    pb_node_account_dispatch_latency(pg, node);
+
+    pb_jobserver_release(pg, node);
+    pb_node_free_slot(pg, node);
+
+    pg->nodes_running--;
 }
 
 /**
- * @brief For each priority move across the graph and build the nodes that belong to the current priority.
- * Assign a CPU core to a single node that has to be built and when it finishes go to the next node and
- * so on until there are no more nodes with the that priority.
+ * @brief Build the nodes of the graph following their priority.
+ * Assign a slot to the ready node with the lowest priority and when a node finishes, its children
+ * whose parents are all built are pushed to the ready heap, and so on until there are no more nodes.
+ * All the make processes are started and watched from this thread.
  * @param pg Main struct
  * @return PB_OK if successful, PB_FAIL otherwise
  */
 PBResult pb_graph_exec(PBMain pg)
 {
-    GList       *list;
+    guint       i;
     PBNode      node;
     gulong      elapsed_usecs = 0;
-    GString     *logs,
-                *elapsed_time_str;
+    GString     *elapsed_time_str;
+    GPtrArray   *done;
 
     if (!pg)
         return PB_FAIL;
 
-    if (pb_th_init_pool(pg) != PB_OK) {
-        pb_log(PB_ERR, "Failed to init thread pool");
+    if (pb_exec_init(pg) != PB_OK) {
+        pb_log(PB_ERR, "Failed to init the executor\n");
         return PB_FAIL;
     }
 
     /* Create path where the output will be writen: ${CONFIG_DIR}/pbuilder_logs/<package>.log */
-    logs = g_string_new(NULL);
-    g_string_printf(logs, "%s/pbuilder_logs", pg->env->config_dir);
+    if (pb_logs_init(pg) != PB_OK) {
+        pb_log(PB_ERR, "Failed to create the logs directory\n");
+        pb_exec_free(pg);
+        return PB_FAIL;
+    }
 
-    mkdir(logs->str, S_IRWXU);
-        /*if (mkdir(logs->str, S_IRWXU) != 0)*/
-        /*pb_log(PB_WARN, "%s(): mkdir(): %s: %s", __func__, logs->str, strerror(errno));*/
-    g_string_free(logs, TRUE);
+    if (pg->mem_budget_kb)
+        pb_log(PB_INFO, "===== Memory budget: %" G_GINT64_FORMAT " MB\n", pg->mem_budget_kb / 1024);
+
+    if (pb_jobserver_init(pg) != PB_OK) {
+        pb_log(PB_ERR, "Failed to create the jobserver\n");
+        pb_exec_free(pg);
+        return PB_FAIL;
+    }
 
     pg->br2_ext_file = g_string_new(NULL);
     g_string_printf(pg->br2_ext_file, "%s/%s", pg->env->config_dir, BR2_EXT_EXEC_ONCE_FILE);
     remove(pg->br2_ext_file->str);
 
-    pb_log(PB_INFO, "========== Building %u packages using br-pbuilder\n", g_list_length(pg->graph));
+    pb_log(PB_INFO, "========== Building %u packages using br-pbuilder (scheduling policy: %s)\n",
+        pg->nodes_num, pg->policy->name);
+
+    pg->slot_used_len = MAX(pg->slots, pg->slots_max);
+    pg->slot_used = g_new0(gboolean, pg->slot_used_len);
 
     pg->timer = g_timer_new();
+    pg->start_usecs = g_get_monotonic_time();
+
+    if (pb_trace_open(pg) != PB_OK) {
+        pb_log(PB_ERR, "Failed to create the trace file");
+        return PB_FAIL;
+    }
+
+    pb_ready_heap_init(pg);
+    pb_prefetch_init(pg);
+
+    done = g_ptr_array_new();
 
     while (TRUE) {
-        if (g_thread_pool_get_num_threads(pg->th_pool) > pg->cpu_num){
-            pb_log(PB_ERR, "Number of threads is greater than the number of CPUs. Halting build!\n");
-            pg->build_error = TRUE;
-            break;
-        }
+        gboolean    no_tokens = FALSE;
+        gint64      deadline = G_MAXINT64;
 
-        guint num_threads_available = (guint)(pg->cpu_num) - g_thread_pool_get_num_threads(pg->th_pool);
+        pb_adapt_update(pg);
 
-        for (list = pg->graph; list != NULL; list = list->next) {
-            gboolean dependencies_built = TRUE;
-            node = list->data;
+        /* Start the ready nodes with the lowest priority while there are free slots.
+         * After an error, only the running nodes are waited for, unless keep_going is set */
+        while (!pg->build_error && pg->nodes_running < pg->slots && pg->ready_num > 0) {
+            node = &pg->nodes[pg->ready_heap[0]];
 
-            if (num_threads_available == 0) {
+            /* Wait until a running node is done if it doesn't fit in the memory budget */
+            if (!pb_mem_admit(pg, node))
+                break;
+
+            if (!pb_jobserver_acquire(pg, node)) {
+                pb_mem_release(pg, node);
+                no_tokens = TRUE;
                 break;
             }
 
-            if (node->status != PB_STATUS_READY){
+            node = pb_sched_ready_pop(pg);
+
+            /* Its sources are still being prefetched: it's pushed again when they're done */
+            if (node->prefetch == PB_PREFETCH_RUNNING) {
+                pb_debug(1, DBG_EXEC, "Package '%s' waits for its sources to be prefetched\n", node->name);
+                node->prefetch = PB_PREFETCH_DEFERRED;
+                pb_jobserver_release(pg, node);
+                pb_mem_release(pg, node);
                 continue;
             }
 
             if (pb_node_already_built(node)){
-                pb_log(PB_WARN, "Package '%s' was already built. Skipping!\n", node->name->str);
+                pb_log(PB_WARN, "Package '%s' was already built. Skipping!\n", node->name);
+                pb_trace_instant(pg, node, "already-built");
+                pb_jobserver_release(pg, node);
+                pb_mem_release(pg, node);
+                pb_node_set_done(pg, node);
                 continue;
             }
 
-            for (GList *parent_list = node->parents; parent_list != NULL; parent_list = parent_list->next) {
-                PBNode parent_node = parent_list->data;
-                if (parent_node->status != PB_STATUS_DONE) {
-                    dependencies_built = FALSE;
-                    break;
-                }
-            }
-
-            if (dependencies_built) {
-                printf("Processing '%s'\n", node->name->str);
-                if (g_thread_pool_push(pg->th_pool, (gpointer)node, NULL) != TRUE) {
-                    pb_log(PB_ERR, "%s(): Failed to create thread for package '%s'", __func__, node->name->str);
-                    pg->build_error = TRUE;
-                    break;
-                }
-                node->status = PB_STATUS_PROCESSING;
-                num_threads_available--;
+            printf("Processing '%s'\n", node->name);
+            node->status = PB_STATUS_PROCESSING;
+            if (pb_exec_start(pg, node) != PB_OK) {
+                pb_log(PB_ERR, "%s(): Failed to start the build of package '%s'", __func__, node->name);
+                pb_trace_instant(pg, node, "failure");
+                pb_jobserver_release(pg, node);
+                pb_mem_release(pg, node);
+                node->exit_status = -1;
+                pb_node_set_failed(pg, node);
+                pb_node_set_done(pg, node);
+                continue;
             }
+            pb_node_take_slot(pg, node);
+            pb_trace_start(pg, node);
+            pg->nodes_running++;
         }
 
-        if (pg->build_error) {
-            pb_log(PB_ERR, "Halting build due to previous errors!\n");
+        pb_prefetch_start(pg);
+
+        pb_trace_counters(pg);
+
+        /* Nothing else is built after an error, so the sources being prefetched aren't needed */
+        if (pg->build_error && !pg->nodes_running)
+            pb_prefetch_stop(pg);
+
+        if (!pg->nodes_running && !pg->prefetch_running) {
+            if (pg->build_error)
+                pb_log(PB_ERR, "Halting build due to previous errors!\n");
             break;
         }
 
-        if (!g_thread_pool_get_num_threads(pg->th_pool))
-            break;
-        
-        sleep(1);
+        /* Sleep until a make process exits. The tokens are given back by the make processes
+         * too, so check them again from time to time */
+        if (no_tokens)
+            deadline = g_get_monotonic_time() + PB_JOBSERVER_POLL_USECS;
+        if (pg->adaptive)
+            deadline = MIN(deadline, pg->adapt_next_usecs);
+
+        pb_exec_wait(pg, deadline, done);
+
+        for (i = 0; i < done->len; i++) {
+            PBProc  proc = g_ptr_array_index(done, i);
+
+            if (!proc->prefetch)
+                pb_node_finish(pg, proc);
+            else if (pb_prefetch_finish(pg, proc))
+                pb_ready_heap_push(pg, proc->node);
+
+            pb_exec_proc_free(proc);
+        }
+        g_ptr_array_set_size(done, 0);
+
+        pb_trace_counters(pg);
     }
 
-    pb_th_wait_for_all_threads(pg);
+    /* The build went on after the errors, but it failed anyway */
+    if (pg->nodes_failed)
+        pg->build_error = TRUE;
+
+    g_ptr_array_free(done, TRUE);
+    g_free(pg->slot_used);
+    pg->slot_used = NULL;
+    pb_prefetch_free(pg);
+
+    pb_trace_close(pg);
+
+    if (pb_history_save(pg) != PB_OK)
+        pb_log(PB_WARN, "Failed to save the building time history\n");
 
     remove(pg->br2_ext_file->str);
 
@@ -342,18 +554,42 @@ PBResult pb_graph_exec(PBMain pg)
 
     elapsed_time_str = elapsed_time_nice_output(pg->elapsed_secs);
     pb_log(PB_INFO, "===== Total elapsed time: %s (%.3f secs)\n", elapsed_time_str->str, pg->elapsed_secs);
+    if (pg->dispatch_count > 0)
+        pb_log(PB_INFO, "===== Dispatch latency (ready to running): avg %.3f ms, max %.3f ms\n",
+            (gdouble)pg->dispatch_total_usecs / pg->dispatch_count / 1000.0, pg->dispatch_max_usecs / 1000.0);
+    pb_rusage_print_summary(pg);
+    pb_steps_print_summary(pg);
+
+    pb_prefetch_print_summary(pg);
+    if (pg->oom_requeued > 0)
+        pb_log(PB_WARN, "===== Builds started again after being killed by the OOM killer: %u\n", pg->oom_requeued);
+    if (pg->nodes_failed > 0)
+        pb_log(PB_WARN, "===== Kept going after the errors: %u packages failed, %u packages blocked by them\n",
+            pg->nodes_failed, pg->nodes_blocked);
+    if (pg->adaptive)
+        pb_log(PB_INFO, "===== Concurrency adjusted %u times between %u and %u slots, final %u\n",
+            pg->slots_changes, pg->slots_min, pg->slots_max, pg->slots);
     g_string_free(elapsed_time_str, TRUE);
     g_timer_destroy(pg->timer);
     pg->timer = NULL;
 
     if (pg->build_error) {
         pb_log(PB_ERR, "Build failed!!!\n");
-        pb_log(PB_ERR, "See pbuilder_logs/<pkg>.log for further info.\n");
+        pb_log(PB_ERR, "See %s/<pkg>.log for further info.\n", PB_LOGS_DIR);
         pb_log(PB_ERR, "The following packages gave an error:\n");
-        for (list = pg->graph; list != NULL; list = list->next) {
-            node = list->data;
+        for (i = 0; i < pg->nodes_num; i++) {
+            node = &pg->nodes[pg->sorted[i]];
             if (node->build_failed)
-                pb_log(PB_ERR, "%s\n", node->name->str);
+                pb_log(PB_ERR, "%s\n", node->name);
+        }
+        if (pg->nodes_blocked) {
+            pb_log(PB_ERR, "The following %u packages were not built because they depend on a package that gave an error:\n",
+                pg->nodes_blocked);
+            for (i = 0; i < pg->nodes_num; i++) {
+                node = &pg->nodes[pg->sorted[i]];
+                if (node->status == PB_STATUS_BLOCKED)
+                    pb_log(PB_ERR, "%s\n", node->name);
+            }
         }
         return PB_FAIL;
     }
@@ -0,0 +1,163 @@
+/**
+ * @file graph_steps.c
+ * @brief Split each package into nodes that run the Buildroot targets of its steps:
+ * <pkg>-extract, <pkg>-patch, <pkg>-configure, <pkg>-build and <pkg>-install. Each node depends
+ * on the previous step of the same package. Only the configure step depends on the packages the
+ * package depends on, since that's when Buildroot needs them installed. The extract and patch
+ * steps only wait for the host packages it depends on, because the tools needed to download,
+ * extract and patch a package are always host packages. So the first steps of a package are done
+ * while its other dependencies are being built.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "graph_steps.h"
+#include "graph_create.h"
+
+typedef enum
+{
+    PB_GRAPH_STEP_EXTRACT,
+    PB_GRAPH_STEP_PATCH,
+    PB_GRAPH_STEP_CONFIGURE,
+    PB_GRAPH_STEP_BUILD,
+    PB_GRAPH_STEP_INSTALL,
+    PB_GRAPH_STEPS_NUM
+} PBGraphStep;
+
+/**
+ * Suffix of the Buildroot target of each node, the steps it builds and the stamp file
+ * left in the build directory of the package when it's done. The extract target downloads the package too.
+ */
+static const struct
+{
+    const gchar     *target;
+    guint           steps;
+    const gchar     *stamp;
+} pb_graph_steps[PB_GRAPH_STEPS_NUM] = {
+    { "extract",    PB_STEP_MASK(PB_STEP_STARTUP) | PB_STEP_MASK(PB_STEP_DOWNLOAD) | PB_STEP_MASK(PB_STEP_EXTRACT),
+                    ".stamp_extracted" },
+    { "patch",      PB_STEP_MASK(PB_STEP_PATCH),        ".stamp_patched" },
+    { "configure",  PB_STEP_MASK(PB_STEP_CONFIGURE),    ".stamp_configured" },
+    { "build",      PB_STEP_MASK(PB_STEP_BUILD),        ".stamp_built" },
+    { "install",    PB_STEP_MASK(PB_STEP_INSTALL_STAGING) | PB_STEP_MASK(PB_STEP_INSTALL_TARGET) |
+                    PB_STEP_MASK(PB_STEP_INSTALL_HOST) | PB_STEP_MASK(PB_STEP_INSTALL_IMAGES),
+                    ".stamp_installed" }
+};
+
+/**
+ * @brief Get the stamp file that a node leaves in the build directory of its package when it's done
+ * @param node The node
+ * @return The name of the stamp file
+ */
+const gchar * pb_graph_steps_get_stamp(PBNode node)
+{
+    guint   s;
+
+    for (s = 0; s < PB_GRAPH_STEPS_NUM; s++)
+        if (node->steps == pb_graph_steps[s].steps)
+            return pb_graph_steps[s].stamp;
+
+    return pb_graph_steps[PB_GRAPH_STEP_INSTALL].stamp;
+}
+
+/**
+ * @brief Add as parents of the node being created the install step of the packages
+ * a package depends on
+ * @param b The graph builder
+ * @param pkg The package
+ * @param pkgs The graph of packages
+ * @param host_only Only the host packages are added
+ * @param name Buffer for the names
+ */
+static void pb_graph_steps_add_deps(PBGraphBuilder b, PBNode pkg, PBMain pkgs, gboolean host_only, GString *name)
+{
+    guint   i;
+
+    for (i = pkgs->parents_off[pkg->id]; i < pkgs->parents_off[pkg->id + 1]; i++) {
+        PBNode  parent = &pkgs->nodes[pkgs->parents[i]];
+
+        if (parent->id == 0 || (host_only && !pb_node_is_host(parent)))
+            continue;
+
+        g_string_printf(name, "%s-%s", parent->name, pb_graph_steps[PB_GRAPH_STEP_INSTALL].target);
+        pb_graph_builder_add_parent(b, name->str);
+    }
+}
+
+/**
+ * @brief Replace every package of the graph, which must be linked but not sorted yet,
+ * by a node for each of its steps
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_graph_steps_split(PBMain pg)
+{
+    struct pbuilder_graph_builder_st b;
+    struct pbuilder_main_st pkgs;
+    GString     *name;
+    PBNode      node;
+    guint       i,
+                s;
+    PBResult    ret = PB_OK;
+
+    if (!pg || !pg->nodes)
+        return PB_FAIL;
+
+    /* The graph of packages is moved aside and the graph of steps is created in its place */
+    pkgs = *pg;
+    pg->nodes = NULL;
+    pg->parents_off = pg->parents = pg->children_off = pg->children = NULL;
+
+    pb_graph_builder_init(&b, pg, (gsize)pkgs.nodes_num * PB_GRAPH_STEPS_NUM * 32);
+
+    name = g_string_new(NULL);
+
+    for (i = 1; ret == PB_OK && i < pkgs.nodes_num; i++) {
+        PBNode  pkg = &pkgs.nodes[i];
+
+        for (s = 0; s < PB_GRAPH_STEPS_NUM; s++) {
+            g_string_printf(name, "%s-%s", pkg->name, pb_graph_steps[s].target);
+
+            if ((node = pb_graph_builder_add_node(&b, name->str, pkg->version)) == NULL) {
+                pb_log(PB_ERR, "%s(): The step '%s' of '%s' is also a package\n", __func__, name->str, pkg->name);
+                ret = PB_FAIL;
+                break;
+            }
+
+            node->type = g_string_chunk_insert_const(pg->names, pkg->type);
+            node->build_system = g_string_chunk_insert_const(pg->names, pkg->build_system);
+            node->install = pkg->install;
+            node->package = g_string_chunk_insert_const(pg->names, pkg->name);
+            node->steps = pb_graph_steps[s].steps;
+
+            if (s == PB_GRAPH_STEP_EXTRACT)
+                pb_graph_steps_add_deps(&b, pkg, &pkgs, TRUE, name);
+            else {
+                g_string_printf(name, "%s-%s", pkg->name, pb_graph_steps[s - 1].target);
+                pb_graph_builder_add_parent(&b, name->str);
+
+                if (s == PB_GRAPH_STEP_CONFIGURE)
+                    pb_graph_steps_add_deps(&b, pkg, &pkgs, FALSE, name);
+            }
+        }
+    }
+
+    g_string_free(name, TRUE);
+
+    ret = pb_graph_builder_finish(&b, ret);
+
+    if (ret == PB_OK)
+        pb_log(PB_INFO, "Graph of %u packages split into %u steps\n", pkgs.nodes_num - 1, pg->nodes_num - 1);
+
+    g_hash_table_destroy(pkgs.nodes_by_name);
+    g_string_chunk_free(pkgs.names);
+    g_free(pkgs.nodes);
+    g_free(pkgs.parents_off);
+    g_free(pkgs.parents);
+    g_free(pkgs.children_off);
+    g_free(pkgs.children);
+
+    return ret;
+}
@@ -0,0 +1,19 @@
+/**
+ * @file graph_steps.h
+ * @brief Split each package of the graph into nodes that build its steps
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _GRAPH_STEPS_H_
+#define _GRAPH_STEPS_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+const gchar *   pb_graph_steps_get_stamp(PBNode);
+PBResult    pb_graph_steps_split(PBMain);
+
+#endif  /* _GRAPH_STEPS_H_ */
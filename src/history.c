@@ -0,0 +1,379 @@
+/**
+ * @file history.c
+ * @brief Load and save the time required to build each package, so the next runs
+ * can estimate how long each node will take and how long the whole build will take.
+ * The file ${CONFIG_DIR}/pbuilder_history contains one sample per line:
+ * "<name> <version> <secs> <exit status> <timestamp> <max rss kB> <steps>"
+ * where <steps> is the time spent in each step as "<step>=<secs>,..." or "-".
+ * The last fields are missing in the files written by older versions.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "history.h"
+#include "steps.h"
+
+static void pb_history_sample_free(gpointer data)
+{
+    PBHistorySample sample = data;
+
+    g_free(sample->version);
+    g_free(sample);
+}
+
+/**
+ * @brief Add a sample to the list of samples of a package.
+ * Only the newest PB_HISTORY_MAX_SAMPLES samples are kept.
+ * @param pg Main struct
+ * @param name The package name
+ * @param version The package version or "-" if it doesn't have one
+ * @param secs Time required to build the package
+ * @param exit_status Exit status of 'make <package>'
+ * @param timestamp Real time in seconds when the package finished
+ * @param maxrss_kb Peak RSS in kB of its largest process or 0 if unknown
+ * @param step_secs Time spent in each step or NULL if unknown
+ */
+static void pb_history_add_sample(PBMain pg, const gchar *name, const gchar *version,
+    gdouble secs, gint exit_status, gint64 timestamp, gint64 maxrss_kb, const gdouble *step_secs)
+{
+    PBHistorySample sample;
+    GPtrArray       *samples;
+
+    samples = g_hash_table_lookup(pg->history, name);
+    if (!samples) {
+        samples = g_ptr_array_new_with_free_func(pb_history_sample_free);
+        g_hash_table_insert(pg->history, g_strdup(name), samples);
+    }
+
+    sample = g_new0(struct pbuilder_history_sample_st, 1);
+    sample->version = g_strdup(version);
+    sample->secs = secs;
+    sample->exit_status = exit_status;
+    sample->timestamp = timestamp;
+    sample->maxrss_kb = maxrss_kb;
+    if (step_secs)
+        memcpy(sample->step_secs, step_secs, sizeof(sample->step_secs));
+
+    g_ptr_array_add(samples, sample);
+
+    if (samples->len > PB_HISTORY_MAX_SAMPLES)
+        g_ptr_array_remove_index(samples, 0);
+}
+
+static gint pb_history_cmp_secs(gconstpointer a, gconstpointer b)
+{
+    gdouble secs_a = *(const gdouble *)a;
+    gdouble secs_b = *(const gdouble *)b;
+
+    return (secs_a > secs_b) - (secs_a < secs_b);
+}
+
+/**
+ * @brief Get the time spent by a sample in some steps
+ * @param sample The sample
+ * @param steps The steps as a mask of PB_STEP_MASK()
+ * @param secs Where the time is stored
+ * @return TRUE if the sample has the time of its steps, FALSE if it was written before they were measured
+ */
+static gboolean pb_history_sample_get_steps(PBHistorySample sample, guint steps, gdouble *secs)
+{
+    gdouble total = 0;
+    guint   i;
+
+    *secs = 0;
+
+    for (i = 0; i < PB_STEP_NUM; i++) {
+        total += sample->step_secs[i];
+        if (steps & PB_STEP_MASK(i))
+            *secs += sample->step_secs[i];
+    }
+
+    return total > 0;
+}
+
+/**
+ * @brief Estimate the time required to build a package, or some of its steps, as the median of
+ * its successful samples. The samples of the same version are preferred over the samples of other versions.
+ * @param samples The samples of the package
+ * @param version The current version of the package
+ * @param steps The steps as a mask of PB_STEP_MASK() or 0 for the whole package
+ * @param secs Where the estimation is stored
+ * @return TRUE if there's at least one successful sample, FALSE otherwise
+ */
+static gboolean pb_history_estimate(GPtrArray *samples, const gchar *version, guint steps, gdouble *secs)
+{
+    GArray  *values;
+    gdouble value;
+    guint   i;
+    gint    pass;
+
+    values = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+    /* First pass: same version. Second pass: any version */
+    for (pass = 0; pass < 2 && values->len == 0; pass++) {
+        for (i = 0; i < samples->len; i++) {
+            PBHistorySample sample = g_ptr_array_index(samples, i);
+
+            if (sample->exit_status != 0)
+                continue;
+            if (pass == 0 && g_strcmp0(sample->version, version))
+                continue;
+
+            value = sample->secs;
+            if (steps && !pb_history_sample_get_steps(sample, steps, &value))
+                continue;
+
+            g_array_append_val(values, value);
+        }
+    }
+
+    if (values->len == 0) {
+        g_array_free(values, TRUE);
+        return FALSE;
+    }
+
+    g_array_sort(values, pb_history_cmp_secs);
+    *secs = g_array_index(values, gdouble, values->len / 2);
+
+    g_array_free(values, TRUE);
+
+    return TRUE;
+}
+
+/**
+ * @brief Estimate the peak RSS of a package as the max of its successful samples
+ * that have it. The samples of the same version are preferred.
+ * @param samples The samples of the package
+ * @param version The current version of the package
+ * @param maxrss_kb Where the estimation is stored
+ * @return TRUE if there's at least one successful sample with RSS, FALSE otherwise
+ */
+static gboolean pb_history_estimate_rss(GPtrArray *samples, const gchar *version, gint64 *maxrss_kb)
+{
+    guint   i;
+    gint    pass;
+
+    *maxrss_kb = 0;
+
+    for (pass = 0; pass < 2 && *maxrss_kb == 0; pass++) {
+        for (i = 0; i < samples->len; i++) {
+            PBHistorySample sample = g_ptr_array_index(samples, i);
+
+            if (sample->exit_status != 0)
+                continue;
+            if (pass == 0 && g_strcmp0(sample->version, version))
+                continue;
+
+            *maxrss_kb = MAX(*maxrss_kb, sample->maxrss_kb);
+        }
+    }
+
+    return *maxrss_kb > 0;
+}
+
+/**
+ * @brief Get the path of the history file
+ * @param pg Main struct
+ * @return A newly allocated string
+ */
+static gchar * pb_history_get_path(PBMain pg)
+{
+    return g_strdup_printf("%s/%s", pg->env->config_dir, PB_HISTORY_FILE);
+}
+
+/**
+ * @brief Read the history file and set the expected building time and peak RSS of each node.
+ * A node that builds some steps of a package and has no history of its own takes the time of those
+ * steps and the peak RSS from the history of the package. Nodes without history get the average
+ * of the nodes that have it or PB_HISTORY_DEFAULT_SECS and PB_HISTORY_DEFAULT_RSS_KB if there's no history at all.
+ * A missing history file is not an error.
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_history_load(PBMain pg)
+{
+    gchar       line[BUFF_4K],
+                name[BUFF_1K],
+                version[BUFF_1K],
+                steps[BUFF_1K],
+                *path;
+    gdouble     step_secs[PB_STEP_NUM];
+    gdouble     secs,
+                total_secs = 0,
+                fallback_secs = PB_HISTORY_DEFAULT_SECS;
+    gint        exit_status,
+                fields;
+    gint64      timestamp,
+                maxrss_kb,
+                total_rss_kb = 0,
+                fallback_rss_kb = PB_HISTORY_DEFAULT_RSS_KB;
+    guint       i,
+                rss_known = 0;
+    FILE        *fd;
+
+    if (!pg || !pg->env)
+        return PB_FAIL;
+
+    pg->history = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+    pg->history_known = 0;
+
+    path = pb_history_get_path(pg);
+
+    if ((fd = fopen(path, "r")) != NULL) {
+        while (fgets(line, sizeof(line), fd)) {
+            if (line[0] == '#')
+                continue;
+
+            maxrss_kb = 0;
+            fields = sscanf(line, "%1023s %1023s %lf %d %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " %1023s",
+                name, version, &secs, &exit_status, &timestamp, &maxrss_kb, steps);
+            if (fields < 7)
+                strcpy(steps, "-");
+            if (fields < 5 || secs < 0 || maxrss_kb < 0 || pb_steps_from_string(steps, step_secs) != PB_OK) {
+                pb_debug(1, DBG_CREATE, "Ignoring invalid history line: %s", line);
+                continue;
+            }
+
+            pb_history_add_sample(pg, name, version, secs, exit_status, timestamp, maxrss_kb, step_secs);
+        }
+        fclose(fd);
+    }
+    else if (errno != ENOENT)
+        pb_log(PB_WARN, "%s(): fopen(): %s: %s\n", __func__, path, strerror(errno));
+
+    g_free(path);
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode      node = &pg->nodes[i];
+        GPtrArray   *samples = g_hash_table_lookup(pg->history, node->name),
+                    *pkg_samples = node->steps ? g_hash_table_lookup(pg->history, node->package) : NULL;
+        const gchar *version = (node->version[0] != '\0') ? node->version : "-";
+
+        if ((samples && pb_history_estimate(samples, version, 0, &node->weight_secs)) ||
+                (pkg_samples && pb_history_estimate(pkg_samples, version, node->steps, &node->weight_secs))) {
+            total_secs += node->weight_secs;
+            pg->history_known++;
+        }
+        else
+            node->weight_secs = -1;
+
+        if ((samples && pb_history_estimate_rss(samples, version, &node->weight_rss_kb)) ||
+                (pkg_samples && pb_history_estimate_rss(pkg_samples, version, &node->weight_rss_kb))) {
+            total_rss_kb += node->weight_rss_kb;
+            rss_known++;
+        }
+    }
+
+    if (pg->history_known > 0)
+        fallback_secs = total_secs / pg->history_known;
+    if (rss_known > 0)
+        fallback_rss_kb = total_rss_kb / rss_known;
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        if (pg->nodes[i].weight_secs < 0)
+            pg->nodes[i].weight_secs = fallback_secs;
+        if (pg->nodes[i].weight_rss_kb == 0)
+            pg->nodes[i].weight_rss_kb = fallback_rss_kb;
+    }
+
+    pb_debug(1, DBG_CREATE, "Building time history found for %u of %u packages\n",
+        pg->history_known, pg->nodes_num - 1);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Add a sample for each package built in this run, successfully or not,
+ * and write the whole history back. The packages that were not built keep their samples.
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_history_save(PBMain pg)
+{
+    GList           *names,
+                    *list;
+    GString         *contents;
+    GError          *error = NULL;
+    gchar           *path;
+    gint64          now;
+    guint           i;
+
+    if (!pg || !pg->history)
+        return PB_FAIL;
+
+    now = g_get_real_time() / G_USEC_PER_SEC;
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        /* Only the nodes built in this run have a start time */
+        if (!node->start_usecs || node->status != PB_STATUS_DONE)
+            continue;
+
+        pb_history_add_sample(pg, node->name, (node->version[0] != '\0') ? node->version : "-",
+            node->elapsed_secs, node->exit_status, now, node->maxrss_kb, node->step_secs);
+    }
+
+    contents = g_string_new("# pbuilder history: <name> <version> <secs> <exit status> <timestamp> <max rss kB> <steps>\n");
+
+    names = g_list_sort(g_hash_table_get_keys(pg->history), (GCompareFunc)g_strcmp0);
+
+    for (list = names; list; list = list->next) {
+        GPtrArray   *samples = g_hash_table_lookup(pg->history, list->data);
+
+        for (i = 0; i < samples->len; i++) {
+            PBHistorySample sample = g_ptr_array_index(samples, i);
+
+            g_string_append_printf(contents, "%s %s %.3f %d %" G_GINT64_FORMAT " %" G_GINT64_FORMAT " ",
+                (gchar *)list->data, sample->version, sample->secs, sample->exit_status, sample->timestamp,
+                sample->maxrss_kb);
+            pb_steps_to_string(sample->step_secs, contents);
+            g_string_append_c(contents, '\n');
+        }
+    }
+
+    g_list_free(names);
+
+    path = pb_history_get_path(pg);
+
+    if (!g_file_set_contents(path, contents->str, contents->len, &error)) {
+        pb_log(PB_ERR, "%s(): Failed to write %s: %s\n", __func__, path, error->message);
+        g_error_free(error);
+        g_free(path);
+        g_string_free(contents, TRUE);
+        return PB_FAIL;
+    }
+
+    g_free(path);
+    g_string_free(contents, TRUE);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Estimate the time required to build the nodes that are not done yet using
+ * the expected building times and the number of packages built at the same time.
+ * @param pg Main struct
+ * @return The estimated time in seconds or a negative value if there's no history
+ */
+gdouble pb_history_get_eta(PBMain pg)
+{
+    if (!pg || !pg->history_known || !pg->slots)
+        return -1;
+
+    return MAX(pg->remaining_secs, 0) / pg->slots;
+}
+
+/**
+ * @brief Free the history table
+ * @param pg Main struct
+ */
+void pb_history_free(PBMain pg)
+{
+    if (pg && pg->history) {
+        g_hash_table_destroy(pg->history);
+        pg->history = NULL;
+    }
+}
@@ -0,0 +1,53 @@
+/**
+ * @file history.h
+ * @brief Building times of the packages measured in previous runs
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+#define PB_HISTORY_FILE             "pbuilder_history"
+
+/**
+ * Max number of samples kept for each package
+ */
+#define PB_HISTORY_MAX_SAMPLES      10
+
+/**
+ * Weight given to every package when there's no history at all
+ */
+#define PB_HISTORY_DEFAULT_SECS     60.0
+
+/**
+ * Peak RSS given to every package when there's no history at all
+ */
+#define PB_HISTORY_DEFAULT_RSS_KB   (512 * 1024)
+
+typedef struct pbuilder_history_sample_st *    PBHistorySample;
+
+/**
+ * A single measurement of the time required to build a package
+ */
+struct pbuilder_history_sample_st
+{
+    gchar           *version;           /**< Package version or "-" */
+    gdouble         secs;               /**< Time required to build the package */
+    gint            exit_status;        /**< Exit status of 'make <package>' */
+    gint64          timestamp;          /**< Real time in seconds when the package finished */
+    gint64          maxrss_kb;          /**< Peak RSS in kB of its largest process or 0 if unknown */
+    gdouble         step_secs[PB_STEP_NUM]; /**< Time spent in each step or all 0 if unknown */
+};
+
+PBResult    pb_history_load(PBMain);
+PBResult    pb_history_save(PBMain);
+gdouble     pb_history_get_eta(PBMain);
+void        pb_history_free(PBMain);
+
+#endif  /* _HISTORY_H_ */
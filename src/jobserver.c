@@ -0,0 +1,184 @@
+/**
+ * @file jobserver.c
+ * @brief GNU make jobserver owned by pbuilder. All the 'make <package>' processes are
+ * clients of the same jobserver, so the total number of jobs stays at the given limit
+ * no matter how many packages are built at the same time.
+ *
+ * Every make has an implicit token that it doesn't read from the pipe. pbuilder gives
+ * the first running package its own implicit token and reads one token from the pipe
+ * for every other package, so each package starts holding the token of its implicit job.
+ * The token is written back when the package is done.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <fcntl.h>
+
+#include "jobserver.h"
+
+/**
+ * @brief Set MAKEFLAGS so every make executed from now on is a client of the jobserver.
+ * The -j options and jobservers inherited from the calling make are removed and the new ones
+ * are added after the rest of the options, so a first word of single-letter flags without
+ * a dash (e.g. 'rR' or 's') stays first, and before the '--' that starts the variables.
+ * The '-j' word is also what makes Buildroot skip its own -j$(PARALLEL_JOBS).
+ * @param pg Main struct
+ */
+static void pb_jobserver_set_makeflags(PBMain pg)
+{
+    const gchar *old_flags = g_getenv("MAKEFLAGS");
+    GString     *flags;
+    gchar       **words;
+    guint       i;
+
+    flags = g_string_new(NULL);
+    words = g_strsplit(old_flags ? old_flags : "", " ", -1);
+
+    for (i = 0; words[i] && strcmp(words[i], "--"); i++) {
+        if (words[i][0] == '\0' || g_str_has_prefix(words[i], "-j") ||
+                g_str_has_prefix(words[i], "--jobserver"))
+            continue;
+        g_string_append_printf(flags, "%s ", words[i]);
+    }
+
+    g_string_append_printf(flags, "-j%u --jobserver-auth=%d,%d", pg->jobs, pg->jobserver_fds[0], pg->jobserver_fds[1]);
+
+    /* The variables are kept as they are, including the escaped spaces */
+    for (; words[i]; i++)
+        g_string_append_printf(flags, " %s", words[i]);
+
+    g_strfreev(words);
+
+    g_setenv("MAKEFLAGS", flags->str, TRUE);
+
+    pb_debug(1, DBG_EXEC, "MAKEFLAGS: %s\n", flags->str);
+
+    g_string_free(flags, TRUE);
+}
+
+/**
+ * @brief Create the jobserver pipe with one token per job except the implicit one.
+ * The pipe is inherited by the children, while pbuilder takes its tokens through
+ * a non-blocking descriptor of its own so the dispatcher never blocks waiting for a token.
+ * Does nothing if the number of jobs is 0.
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_jobserver_init(PBMain pg)
+{
+    gchar   *path;
+    guint   i;
+
+    if (!pg)
+        return PB_FAIL;
+
+    if (!pg->jobs)
+        return PB_OK;
+
+    if (pipe(pg->jobserver_fds) != 0) {
+        pb_log(PB_ERR, "%s(): pipe(): %s\n", __func__, strerror(errno));
+        pg->jobserver_fds[0] = pg->jobserver_fds[1] = -1;
+        return PB_FAIL;
+    }
+
+    /* A new open file description of the same pipe, so O_NONBLOCK doesn't affect the children */
+    path = g_strdup_printf("/proc/self/fd/%d", pg->jobserver_fds[0]);
+    pg->jobserver_rd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    g_free(path);
+
+    if (pg->jobserver_rd < 0) {
+        pb_log(PB_ERR, "%s(): open(): %s\n", __func__, strerror(errno));
+        pb_jobserver_free(pg);
+        return PB_FAIL;
+    }
+
+    for (i = 1; i < pg->jobs; i++) {
+        gchar   token = PB_JOBSERVER_TOKEN;
+
+        if (write(pg->jobserver_fds[1], &token, 1) != 1) {
+            pb_log(PB_ERR, "%s(): write(): %s\n", __func__, strerror(errno));
+            pb_jobserver_free(pg);
+            return PB_FAIL;
+        }
+    }
+
+    pg->jobserver_implicit_free = TRUE;
+
+    pb_jobserver_set_makeflags(pg);
+
+    pb_log(PB_INFO, "===== Jobserver: %u jobs shared by all the packages\n", pg->jobs);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Take the token of the implicit job of a package that is about to be built.
+ * @param pg Main struct
+ * @param node The node that is about to be built
+ * @return TRUE if the node got a token or if there's no jobserver, FALSE if all the tokens are taken
+ */
+gboolean pb_jobserver_acquire(PBMain pg, PBNode node)
+{
+    gchar   token;
+
+    if (!pg->jobs)
+        return TRUE;
+
+    if (pg->jobserver_implicit_free) {
+        pg->jobserver_implicit_free = FALSE;
+        node->job_token = 0;
+        return TRUE;
+    }
+
+    if (read(pg->jobserver_rd, &token, 1) != 1) {
+        if (errno != EAGAIN && errno != EINTR)
+            pb_log(PB_WARN, "%s(): read(): %s\n", __func__, strerror(errno));
+        return FALSE;
+    }
+
+    node->job_token = token;
+
+    return TRUE;
+}
+
+/**
+ * @brief Give back the token taken by pb_jobserver_acquire().
+ * @param pg Main struct
+ * @param node The node that is done
+ */
+void pb_jobserver_release(PBMain pg, PBNode node)
+{
+    if (!pg->jobs)
+        return;
+
+    if (!node->job_token) {
+        pg->jobserver_implicit_free = TRUE;
+        return;
+    }
+
+    if (write(pg->jobserver_fds[1], &node->job_token, 1) != 1)
+        pb_log(PB_WARN, "%s(): write(): %s\n", __func__, strerror(errno));
+
+    node->job_token = 0;
+}
+
+/**
+ * @brief Close the jobserver pipe
+ * @param pg Main struct
+ */
+void pb_jobserver_free(PBMain pg)
+{
+    if (!pg || !pg->jobs)
+        return;
+
+    if (pg->jobserver_rd >= 0)
+        close(pg->jobserver_rd);
+    if (pg->jobserver_fds[0] >= 0)
+        close(pg->jobserver_fds[0]);
+    if (pg->jobserver_fds[1] >= 0)
+        close(pg->jobserver_fds[1]);
+
+    pg->jobserver_rd = pg->jobserver_fds[0] = pg->jobserver_fds[1] = -1;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file jobserver.h
+ * @brief GNU make jobserver shared by all the packages built at the same time
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _JOBSERVER_H_
+#define _JOBSERVER_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+/**
+ * Byte written to the jobserver pipe for each token
+ */
+#define PB_JOBSERVER_TOKEN          '+'
+
+/**
+ * Time the dispatcher waits before trying again to get a token when all of them are taken
+ */
+#define PB_JOBSERVER_POLL_USECS     (50 * G_TIME_SPAN_MILLISECOND)
+
+PBResult    pb_jobserver_init(PBMain);
+gboolean    pb_jobserver_acquire(PBMain, PBNode);
+void        pb_jobserver_release(PBMain, PBNode);
+void        pb_jobserver_free(PBMain);
+
+#endif  /* _JOBSERVER_H_ */
@@ -0,0 +1,431 @@
+/**
+ * @file logs.c
+ * @brief Build logs of the packages. The output of a make process is moved to its log
+ * in large chunks with splice(), without copying it through user space, while tee()
+ * duplicates it into a second pipe that is scanned for the marker lines and for
+ * the last lines that are printed if the package fails.
+ * The logs can be compressed by an external gzip or zstd process fed in the same way.
+ * Each run starts with an empty pbuilder_logs directory and the previous ones are kept
+ * in .pbuilder_logs.<n>.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+
+#include "logs.h"
+#include "mem.h"
+#include "steps.h"
+
+extern char **environ;
+
+/**
+ * Supported compressors
+ */
+static const struct
+{
+    const gchar     *name;              /**< Name used in the cmdline and executable */
+    const gchar     *suffix;            /**< Suffix of the compressed logs */
+    gchar           *argv[4];           /**< Command that compresses stdin to stdout */
+} pb_logs_compressors[] =
+{
+    { "gzip",   ".gz",  { "gzip", "-c", NULL } },
+    { "zstd",   ".zst", { "zstd", "-q", "-c", NULL } },
+    { NULL }
+};
+
+/**
+ * @brief Remove a logs directory. It only contains files
+ * @param path The directory
+ */
+static void pb_logs_remove_dir(const gchar *path)
+{
+    GDir        *dir;
+    const gchar *name;
+
+    if ((dir = g_dir_open(path, 0, NULL)) == NULL)
+        return;
+
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        gchar   *file = g_build_filename(path, name, NULL);
+
+        unlink(file);
+        g_free(file);
+    }
+
+    g_dir_close(dir);
+    rmdir(path);
+}
+
+/**
+ * @brief Move the logs of the previous runs one position back, dropping the oldest ones,
+ * create an empty logs directory and select the compressor
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_logs_init(PBMain pg)
+{
+    gchar   *path,
+            *old_path,
+            *new_path;
+    gint    i;
+
+    if (!pg)
+        return PB_FAIL;
+
+    pg->log_compressor = -1;
+    if (pg->log_compress) {
+        for (i = 0; pb_logs_compressors[i].name; i++)
+            if (!g_strcmp0(pb_logs_compressors[i].name, pg->log_compress))
+                pg->log_compressor = i;
+
+        if (pg->log_compressor < 0) {
+            pb_log(PB_ERR, "%s(): Invalid log compressor '%s'. Valid compressors: gzip, zstd\n",
+                __func__, pg->log_compress);
+            return PB_FAIL;
+        }
+    }
+
+    old_path = g_strdup_printf("%s/%s.%d", pg->env->config_dir, PB_LOGS_OLD_DIR, PB_LOGS_KEEP_RUNS);
+    pb_logs_remove_dir(old_path);
+    g_free(old_path);
+
+    for (i = PB_LOGS_KEEP_RUNS - 1; i >= 1; i--) {
+        old_path = g_strdup_printf("%s/%s.%d", pg->env->config_dir, PB_LOGS_OLD_DIR, i);
+        new_path = g_strdup_printf("%s/%s.%d", pg->env->config_dir, PB_LOGS_OLD_DIR, i + 1);
+        rename(old_path, new_path);
+        g_free(old_path);
+        g_free(new_path);
+    }
+
+    path = g_strdup_printf("%s/%s", pg->env->config_dir, PB_LOGS_DIR);
+    new_path = g_strdup_printf("%s/%s.1", pg->env->config_dir, PB_LOGS_OLD_DIR);
+    if (rename(path, new_path) != 0 && errno != ENOENT)
+        pb_log(PB_WARN, "%s(): rename(): %s: %s\n", __func__, path, strerror(errno));
+    g_free(new_path);
+
+    if (mkdir(path, S_IRWXU) != 0 && errno != EEXIST) {
+        pb_log(PB_ERR, "%s(): mkdir(): %s: %s\n", __func__, path, strerror(errno));
+        g_free(path);
+        return PB_FAIL;
+    }
+
+    g_free(path);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Get the name of the log of a target relative to ${CONFIG_DIR}
+ * @param pg Main struct
+ * @param target A package or a make target
+ * @return A newly allocated string. Eg. pbuilder_logs/busybox.log.zst
+ */
+gchar * pb_logs_get_name(PBMain pg, const gchar *target)
+{
+    return g_strdup_printf("%s/%s.log%s", PB_LOGS_DIR, target,
+        (pg->log_compressor >= 0) ? pb_logs_compressors[pg->log_compressor].suffix : "");
+}
+
+/**
+ * @brief Start a compressor process that writes to the end of a log file
+ * @param pg Main struct
+ * @param log The log
+ * @param path The log file
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_logs_start_compressor(PBMain pg, PBLog log, const gchar *path)
+{
+    posix_spawn_file_actions_t  actions;
+    gint    fds[2],
+            ret;
+
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return PB_FAIL;
+
+    /* Compressed streams can be concatenated, so a package built again is appended */
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+    ret = posix_spawnp(&log->compressor, pb_logs_compressors[pg->log_compressor].argv[0], &actions, NULL,
+        pb_logs_compressors[pg->log_compressor].argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+
+    if (ret != 0) {
+        pb_log(PB_WARN, "%s(): posix_spawnp(): %s: %s\n", __func__,
+            pb_logs_compressors[pg->log_compressor].argv[0], strerror(ret));
+        close(fds[1]);
+        log->compressor = 0;
+        return PB_FAIL;
+    }
+
+    log->fd = fds[1];
+
+    return PB_OK;
+}
+
+/**
+ * @brief Open the log of a target
+ * @param pg Main struct
+ * @param target A package or a make target
+ * @return The log or NULL if it can't be opened
+ */
+PBLog pb_logs_open(PBMain pg, const gchar *target)
+{
+    PBLog   log;
+    gchar   *name,
+            *path;
+
+    log = g_new0(struct pbuilder_log_st, 1);
+    log->fd = -1;
+    log->scan_fds[0] = log->scan_fds[1] = -1;
+    log->line = g_string_new(NULL);
+    log->step = PB_STEP_STARTUP;
+    log->step_usecs = g_get_monotonic_time();
+    log->tail_size = pg->log_tail;
+    if (log->tail_size)
+        log->tail = g_new0(gchar *, log->tail_size);
+
+    name = pb_logs_get_name(pg, target);
+    path = g_strdup_printf("%s/%s", pg->env->config_dir, name);
+    g_free(name);
+
+    if (pg->log_compressor >= 0)
+        pb_logs_start_compressor(pg, log, path);
+    else {
+        /* splice() doesn't accept O_APPEND, so a package built again is appended by seeking */
+        log->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (log->fd >= 0)
+            lseek(log->fd, 0, SEEK_END);
+    }
+
+    if (log->fd < 0) {
+        pb_log(PB_ERR, "%s(): Failed to open %s: %s\n", __func__, path, strerror(errno));
+        g_free(path);
+        pb_logs_close(log);
+        return NULL;
+    }
+
+    g_free(path);
+
+    if (pipe2(log->scan_fds, O_CLOEXEC | O_NONBLOCK) == 0) {
+        fcntl(log->scan_fds[1], F_SETPIPE_SZ, PB_LOGS_CHUNK);
+        log->zero_copy = TRUE;
+    }
+
+    return log;
+}
+
+/**
+ * @brief Add a complete line to the ring buffer
+ * @param log The log
+ * @param line The line
+ */
+static void pb_logs_tail_add(PBLog log, const GString *line)
+{
+    if (!log->tail_size)
+        return;
+
+    g_free(log->tail[log->tail_next]);
+    log->tail[log->tail_next] = g_strndup(line->str, MIN(line->len, PB_LOGS_TAIL_LINE_MAX));
+    log->tail_next = (log->tail_next + 1) % log->tail_size;
+    if (log->tail_num < log->tail_size)
+        log->tail_num++;
+}
+
+/**
+ * @brief A marker line started a new step: the current one ends now
+ * @param log The log
+ * @param step The new step
+ */
+static void pb_logs_set_step(PBLog log, PBStep step)
+{
+    gint64  now = g_get_monotonic_time();
+
+    log->step_secs[log->step] += (now - log->step_usecs) / (gdouble)G_USEC_PER_SEC;
+    log->step = step;
+    log->step_usecs = now;
+}
+
+/**
+ * @brief Scan a chunk of output: print the marker lines and take the steps they start,
+ * keep the last lines and look for the compiler being killed.
+ * The last line of the chunk is kept until it's complete.
+ * @param log The log
+ * @param buf Chunk of output
+ * @param len Length of the chunk
+ */
+static void pb_logs_scan(PBLog log, const gchar *buf, gssize len)
+{
+    const gchar *end = buf + len,
+                *nl;
+    gint        step;
+
+    while (buf < end) {
+        nl = memchr(buf, '\n', end - buf);
+
+        /* Very long lines are only kept partially */
+        if (log->line->len < PB_LOGS_TAIL_LINE_MAX)
+            g_string_append_len(log->line, buf, MIN((nl ? nl + 1 : end) - buf,
+                PB_LOGS_TAIL_LINE_MAX - (gssize)log->line->len));
+        if (!nl)
+            return;
+
+        if (!strncmp(log->line->str, PB_LOGS_MARKER, strlen(PB_LOGS_MARKER))) {
+            printf("%s", log->line->str);
+            if ((step = pb_steps_from_marker(log->line->str)) >= 0)
+                pb_logs_set_step(log, step);
+        }
+        else if (strstr(log->line->str, PB_MEM_OOM_MARKER))
+            log->oom_hint = TRUE;
+
+        pb_logs_tail_add(log, log->line);
+
+        g_string_truncate(log->line, 0);
+        buf = nl + 1;
+    }
+}
+
+/**
+ * @brief Write a whole buffer
+ * @param fd Where it's written
+ * @param buf The buffer
+ * @param len Its length
+ * @return TRUE if successful, FALSE otherwise
+ */
+static gboolean pb_logs_write_all(gint fd, const gchar *buf, gssize len)
+{
+    gssize  n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return FALSE;
+        }
+        buf += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief Move one chunk of the output of a make process to its log and scan it.
+ * The output is duplicated to the scan pipe with tee() and moved to the log with splice().
+ * If the log doesn't support splice(), it falls back to read() and write().
+ * @param log The log or NULL to discard the output
+ * @param in_fd Read end of the pipe of the make process
+ * @return The number of bytes moved, 0 at the end of the output, or -1 with errno set
+ * (EAGAIN if there's nothing to read in a non-blocking pipe)
+ */
+gssize pb_logs_transfer(PBLog log, gint in_fd)
+{
+    gchar   buf[PB_LOGS_CHUNK];
+    gssize  n,
+            moved,
+            m;
+
+    if (log && log->zero_copy) {
+        n = tee(in_fd, log->scan_fds[1], PB_LOGS_CHUNK, SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            for (moved = 0; moved < n; moved += m) {
+                m = splice(in_fd, NULL, log->fd, NULL, n - moved, SPLICE_F_MOVE);
+                if (m <= 0)
+                    break;
+            }
+
+            /* The scan pipe was empty, so it has exactly n bytes */
+            if (read(log->scan_fds[0], buf, n) == n)
+                pb_logs_scan(log, buf, n);
+
+            if (moved == n)
+                return n;
+
+            /* The log doesn't accept splice(). The rest of the chunk is still in the pipe */
+            log->zero_copy = FALSE;
+            log->scanned_ahead = n - moved;
+            if (moved > 0)
+                return moved;
+        }
+        else if (n == 0 || errno == EAGAIN || errno == EINTR)
+            return n;
+        else
+            log->zero_copy = FALSE;
+    }
+
+    n = read(in_fd, buf, sizeof(buf));
+    if (n > 0 && log) {
+        if (!pb_logs_write_all(log->fd, buf, n))
+            pb_log(PB_WARN, "%s(): write(): %s\n", __func__, strerror(errno));
+
+        m = MIN(n, log->scanned_ahead);
+        log->scanned_ahead -= m;
+        pb_logs_scan(log, buf + m, n - m);
+    }
+
+    return n;
+}
+
+/**
+ * @brief Print the last lines of the output of a target that failed
+ * @param log The log
+ * @param target The package or make target
+ */
+void pb_logs_print_tail(PBLog log, const gchar *target)
+{
+    guint   i;
+
+    if (!log || !log->tail_num)
+        return;
+
+    /* An incomplete last line is shown too */
+    if (log->line->len > 0) {
+        pb_logs_tail_add(log, log->line);
+        g_string_truncate(log->line, 0);
+    }
+
+    pb_log(PB_ERR, "Last %u lines of the output of '%s':\n", log->tail_num, target);
+
+    for (i = 0; i < log->tail_num; i++) {
+        const gchar *line = log->tail[(log->tail_next + log->tail_size - log->tail_num + i) % log->tail_size];
+
+        printf("    %s%s", line, g_str_has_suffix(line, "\n") ? "" : "\n");
+    }
+}
+
+/**
+ * @brief Close a log and wait for its compressor
+ * @param log The log
+ */
+void pb_logs_close(PBLog log)
+{
+    guint   i;
+
+    if (!log)
+        return;
+
+    if (log->fd >= 0)
+        close(log->fd);
+    if (log->scan_fds[0] >= 0)
+        close(log->scan_fds[0]);
+    if (log->scan_fds[1] >= 0)
+        close(log->scan_fds[1]);
+
+    if (log->compressor > 0)
+        while (waitpid(log->compressor, NULL, 0) < 0 && errno == EINTR)
+            ;
+
+    for (i = 0; i < log->tail_size; i++)
+        g_free(log->tail[i]);
+    g_free(log->tail);
+
+    g_string_free(log->line, TRUE);
+    g_free(log);
+}
@@ -0,0 +1,76 @@
+/**
+ * @file logs.h
+ * @brief Build logs of the packages: capture, compression, rotation and failure tail
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _LOGS_H_
+#define _LOGS_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+#define PB_LOGS_DIR                 "pbuilder_logs"
+
+/**
+ * The logs of the previous runs are moved to ${CONFIG_DIR}/.pbuilder_logs.<n>,
+ * so Buildroot's 'make clean' removes them too
+ */
+#define PB_LOGS_OLD_DIR             ".pbuilder_logs"
+#define PB_LOGS_KEEP_RUNS           3
+
+/**
+ * Max number of bytes moved from a make process to its log at once
+ */
+#define PB_LOGS_CHUNK               (64 * 1024)
+
+/**
+ * Size requested for the pipes of the make processes
+ */
+#define PB_LOGS_PIPE_SIZE           (1024 * 1024)
+
+/**
+ * Number of lines printed when a package fails and max length of each one
+ */
+#define PB_LOGS_TAIL_LINES          20
+#define PB_LOGS_TAIL_LINE_MAX       512
+
+/**
+ * Lines of the build output that start with this string are printed
+ */
+#define PB_LOGS_MARKER              "\E[7m>>>"
+
+typedef struct pbuilder_log_st *    PBLog;
+
+/**
+ * The log of a make process
+ */
+struct pbuilder_log_st
+{
+    gint            fd;                 /**< Log file or stdin of the compressor */
+    pid_t           compressor;         /**< Compressor process or 0 */
+    gint            scan_fds[2];        /**< Pipe where the output is duplicated with tee() to be scanned */
+    gboolean        zero_copy;          /**< The output is moved to the log with splice() */
+    gssize          scanned_ahead;      /**< Bytes still in the pipe of the make process that were already scanned */
+    GString         *line;              /**< Output line not complete yet */
+    gchar           **tail;             /**< Ring buffer with the last lines */
+    guint           tail_size;          /**< Max number of lines in the ring buffer */
+    guint           tail_next;          /**< Position of the next line in the ring buffer */
+    guint           tail_num;           /**< Number of lines in the ring buffer */
+    gboolean        oom_hint;           /**< A line says that the compiler was killed */
+    PBStep          step;               /**< Current step of the build */
+    gint64          step_usecs;         /**< Monotonic time when the current step started */
+    gdouble         step_secs[PB_STEP_NUM]; /**< Time spent in each finished step */
+};
+
+PBResult    pb_logs_init(PBMain);
+gchar *     pb_logs_get_name(PBMain, const gchar *);
+PBLog       pb_logs_open(PBMain, const gchar *);
+gssize      pb_logs_transfer(PBLog, gint);
+void        pb_logs_print_tail(PBLog, const gchar *);
+void        pb_logs_close(PBLog);
+
+#endif  /* _LOGS_H_ */
@@ -9,18 +9,54 @@
 #include "graph_common.h"
 #include "graph_create.h"
 #include "graph_exec.h"
-
-gint    debug_level;
-gchar   *debug_module;
-gchar   *deps_file;
-gint    cpu_num;
+#include "sched.h"
+#include "adapt.h"
+#include "logs.h"
+#include "sim.h"
 
 static GOptionEntry opt_entries[] =
 {
     { "filename", 'f', 0, G_OPTION_ARG_FILENAME, &deps_file,
-        "Mandatory dependencies file generated by pbuilder.py", NULL },
+        "Dependencies file generated by pbuilder.py. Mandatory unless -i is given", NULL },
+    { "show-info", 'i', 0, G_OPTION_ARG_FILENAME, &show_info,
+        "Read the packages from the JSON printed by 'make show-info' instead of the dependencies file. "
+        "Values: a filename, - (stdin) or make (run 'make show-info')", NULL },
+    { "split-steps", 'S', 0, G_OPTION_ARG_NONE, &split_steps,
+        "Split each package into its extract, patch, configure, build and install steps, so the first "
+        "steps of a package are done while its dependencies are being built. Default: disabled", NULL },
     { "cpu", 'c', 0, G_OPTION_ARG_INT, &cpu_num,
         "Max number of CPUs used to build. Default: 0 (Auto-detect)", NULL },
+    { "schedule", 's', 0, G_OPTION_ARG_STRING, &schedule,
+        "Scheduling policy: order in which the ready packages are built. "
+        "Values: priority, critical-path, descendants, fan-out, fifo-aging. Default: priority", NULL },
+    { "adaptive", 'a', 0, G_OPTION_ARG_STRING, &adaptive,
+        "Adjust the number of packages built at the same time between MIN and MAX according to the "
+        "pressure stall information and the load average. Format: MIN:MAX. Default: disabled", NULL },
+    { "mem-budget", 'M', 0, G_OPTION_ARG_INT, &mem_budget,
+        "Memory in MB that the packages built at the same time are expected to use at most, according to "
+        "the peak RSS measured in previous runs. Default: 0 (unlimited)", NULL },
+    { "prefetch", 'p', 0, G_OPTION_ARG_INT, &prefetch,
+        "Number of packages whose sources are downloaded at the same time ahead of their build with "
+        "'make <pkg>-source', in critical path order and without using the build slots. Default: 0 (disabled)", NULL },
+    { "prefetch-extract", 'x', 0, G_OPTION_ARG_NONE, &prefetch_extract,
+        "Extract the prefetched sources too with 'make <pkg>-extract'. Default: disabled", NULL },
+    { "jobs", 'j', 0, G_OPTION_ARG_INT, &jobs,
+        "Total number of jobs shared by all the packages through a GNU make jobserver. "
+        "Default: 0 (disabled, each package uses BR2_JLEVEL)", NULL },
+    { "log-compress", 'z', 0, G_OPTION_ARG_STRING, &log_compress,
+        "Compress the logs while building. Values: gzip, zstd. Default: disabled", NULL },
+    { "log-tail", 't', 0, G_OPTION_ARG_INT, &log_tail,
+        "Number of lines of the output printed when a package fails. Default: 20", NULL },
+    { "trace", 'T', 0, G_OPTION_ARG_FILENAME, &trace_file,
+        "Write the timeline of the build to a file in the Trace Event Format, "
+        "which can be opened with Perfetto or chrome://tracing. Default: disabled", NULL },
+    { "keep-going", 'k', 0, G_OPTION_ARG_NONE, &keep_going,
+        "Keep building the packages that don't depend on a failed package after an error. "
+        "Default: disabled, the build stops at the first error", NULL },
+    { "simulate", 'n', 0, G_OPTION_ARG_STRING, &simulate,
+        "Simulate the build in virtual time instead of running make and show the makespan, the slot "
+        "utilization and the critical path. Values: history, lognormal[:MEDIAN[:SIGMA]] or a file of "
+        "'<package> <secs>' lines. Default: disabled", NULL },
     { "debug_level", 'l', 0, G_OPTION_ARG_INT, &debug_level,
         "Set debug level. Values: [1-3]. Default: 0 (disabled)", NULL },
     { "debug_module", 'm', 0, G_OPTION_ARG_STRING, &debug_module,
@@ -72,17 +108,43 @@ static PBResult pb_create_main_struct(PBMain *pbg)
     PBMain pg;
 
     pg = g_new0(struct pbuilder_main_st, 1);
-    pg->graph = NULL;
+    pg->nodes = NULL;
     pg->timer = NULL;
     pg->env = NULL;
     pg->br2_ext_file = NULL;
-    g_mutex_init(&pg->nodes_mutex);
+    pg->jobserver_fds[0] = pg->jobserver_fds[1] = pg->jobserver_rd = -1;
+    pg->epoll_fd = -1;
 
-    if (cpu_num < 1 || cpu_num > g_get_num_processors())
+    /* A simulated build can use more CPUs than the host has */
+    if (cpu_num < 1 || (!simulate && cpu_num > g_get_num_processors()))
         pg->cpu_num = g_get_num_processors();
     else
         pg->cpu_num = cpu_num;
 
+    pg->slots = pg->cpu_num;
+    if (adaptive && pb_adapt_parse_range(pg, adaptive) != PB_OK) {
+        pb_graph_free(pg);
+        return PB_FAIL;
+    }
+
+    pg->jobs = (jobs > 0) ? jobs : 0;
+    pg->mem_budget_kb = (mem_budget > 0) ? (gint64)mem_budget * 1024 : 0;
+    pg->prefetch_max = (prefetch > 0) ? prefetch : 0;
+    pg->prefetch_extract = prefetch_extract;
+    pg->keep_going = keep_going;
+    pg->log_compress = log_compress;
+    pg->log_compressor = -1;
+    pg->log_tail = (log_tail > 0) ? log_tail : 0;
+
+    pg->policy = pb_sched_find(schedule ? schedule : SCHED_DEFAULT);
+    if (!pg->policy) {
+        GString *names = pb_sched_list_names();
+        pb_log(PB_ERR, "%s(): Invalid scheduling policy '%s'. Valid policies: %s\n", __func__, schedule, names->str);
+        g_string_free(names, TRUE);
+        pb_graph_free(pg);
+        return PB_FAIL;
+    }
+
     if (pb_get_env(pg) != PB_OK) {
         pb_log(PB_ERR, "%s(): Failed to get environment variables", __func__);
         pb_graph_free(pg);
@@ -112,13 +174,13 @@ int main(int argc, char *argv[])
         g_snprintf(debug_module, sizeof(DBG_ALL), DBG_ALL);
     }
 
-    if (!deps_file) {
+    if (!deps_file && !show_info) {
         pb_log(PB_ERR, "No dependencies filename given. Aborting!");
         g_option_context_free(opt_context);
         return EXIT_FAILURE;
     }
 
-    if (access(deps_file, R_OK) != 0) {
+    if (!show_info && access(deps_file, R_OK) != 0) {
         pb_log(PB_ERR, "Invalid dependencies file: %s", strerror(errno));
         g_option_context_free(opt_context);
         return EXIT_FAILURE;
@@ -136,15 +198,21 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    if (pb_graph_exec(pbg) != PB_OK) {
+    if (simulate) {
+        if (pb_sim_run(pbg, simulate) != PB_OK) {
+            pb_log(PB_ERR, "Failed to simulate the build");
+            pb_graph_free(pbg);
+            g_option_context_free(opt_context);
+            return EXIT_FAILURE;
+        }
+    }
+    else if (pb_graph_exec(pbg) != PB_OK) {
         pb_log(PB_ERR, "Failed to execute graph");
         pb_graph_free(pbg);
         g_option_context_free(opt_context);
         return EXIT_FAILURE;
     }
 
-    g_mutex_clear(&pbg->nodes_mutex);
-
     pb_graph_free(pbg);
 
     g_option_context_free(opt_context);
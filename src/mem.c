@@ -0,0 +1,66 @@
+/**
+ * @file mem.c
+ * @brief Memory-aware admission of the nodes and detection of the builds killed by the OOM killer.
+ * Each node is expected to use the peak RSS measured in previous runs, and a node is started
+ * only if the expected memory of all the running nodes stays under the memory budget.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "mem.h"
+
+/**
+ * @brief Check if a node can be started without exceeding the memory budget and,
+ * if so, add its expected memory to the running total. A node is always admitted if
+ * nothing else is running, otherwise a node bigger than the budget could never be built.
+ * @param pg Main struct
+ * @param node The node that is about to be built
+ * @return TRUE if the node can be started, FALSE otherwise
+ */
+gboolean pb_mem_admit(PBMain pg, PBNode node)
+{
+    if (!pg->mem_budget_kb)
+        return TRUE;
+
+    if (pg->nodes_running > 0 && pg->mem_running_kb + node->weight_rss_kb > pg->mem_budget_kb) {
+        pb_debug(2, DBG_EXEC, "Package '%s' waits for memory: %" G_GINT64_FORMAT " + %" G_GINT64_FORMAT
+            " kB > %" G_GINT64_FORMAT " kB\n", node->name, pg->mem_running_kb, node->weight_rss_kb, pg->mem_budget_kb);
+        return FALSE;
+    }
+
+    pg->mem_running_kb += node->weight_rss_kb;
+
+    return TRUE;
+}
+
+/**
+ * @brief Remove the expected memory of a node from the running total.
+ * @param pg Main struct
+ * @param node A node admitted by pb_mem_admit()
+ */
+void pb_mem_release(PBMain pg, PBNode node)
+{
+    if (!pg->mem_budget_kb)
+        return;
+
+    pg->mem_running_kb -= node->weight_rss_kb;
+}
+
+/**
+ * @brief Check if a failed build was killed by the OOM killer, based only on the evidence of the
+ * build itself: make was killed by SIGKILL or gcc reported that the compiler was killed.
+ * The system-wide OOM kill counter is not used, since a process killed while other packages
+ * were building would make all of them be built again with fewer slots.
+ * @param node The node that failed
+ * @param wait_status Status returned by wait4()
+ * @return TRUE if it was killed by the OOM killer, FALSE otherwise
+ */
+gboolean pb_mem_was_oom_killed(PBNode node, gint wait_status)
+{
+    if (WIFSIGNALED(wait_status) && WTERMSIG(wait_status) == SIGKILL)
+        return TRUE;
+
+    return node->oom_hint;
+}
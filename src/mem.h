@@ -0,0 +1,30 @@
+/**
+ * @file mem.h
+ * @brief Memory-aware admission of the nodes and detection of the builds killed by the OOM killer
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _MEM_H_
+#define _MEM_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+/**
+ * Printed by gcc when the compiler is killed, usually by the OOM killer
+ */
+#define PB_MEM_OOM_MARKER           "Killed signal terminated program"
+
+/**
+ * Max number of times a package killed by the OOM killer is built again
+ */
+#define PB_MEM_MAX_RETRIES          2
+
+gboolean    pb_mem_admit(PBMain, PBNode);
+void        pb_mem_release(PBMain, PBNode);
+gboolean    pb_mem_was_oom_killed(PBNode, gint);
+
+#endif  /* _MEM_H_ */
@@ -0,0 +1,202 @@
+/**
+ * @file prefetch.c
+ * @brief Download the sources of the packages ahead of their build with 'make <package>-source',
+ * or extract them too with 'make <package>-extract', in a pool of processes of its own that
+ * doesn't use the slots of the builds. The packages are prefetched in critical path order,
+ * but only once their host dependencies are built, since the download and extract tools
+ * are host packages that make would build otherwise. A node that is about to be built while
+ * its sources are still being downloaded waits for them instead of downloading them too.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "prefetch.h"
+
+static gint pb_prefetch_cmp_cp(gconstpointer a, gconstpointer b)
+{
+    PBNode  node_a = *(PBNode *)a;
+    PBNode  node_b = *(PBNode *)b;
+
+    if (node_a->cp_secs != node_b->cp_secs)
+        return (node_a->cp_secs < node_b->cp_secs) - (node_a->cp_secs > node_b->cp_secs);
+
+    return (gint)node_a->priority - (gint)node_b->priority;
+}
+
+/**
+ * @brief Create the queue of the nodes whose sources are prefetched: the packages, or
+ * the steps that download them, that are not ready yet. Also count the host parents of
+ * each node that are not built yet.
+ * @param pg Main struct
+ */
+void pb_prefetch_init(PBMain pg)
+{
+    GPtrArray   *queue;
+    guint       i,
+                j;
+
+    if (!pg || !pg->prefetch_max)
+        return;
+
+    queue = g_ptr_array_new();
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        node->pending_host_parents = 0;
+        for (j = pg->parents_off[i]; j < pg->parents_off[i + 1]; j++) {
+            PBNode  parent = &pg->nodes[pg->parents[j]];
+
+            if (parent->id > 0 && parent->status != PB_STATUS_DONE && pb_node_is_host(parent))
+                node->pending_host_parents++;
+        }
+
+        if (node->status == PB_STATUS_PENDING &&
+                (!node->steps || (node->steps & PB_STEP_MASK(PB_STEP_DOWNLOAD))))
+            g_ptr_array_add(queue, node);
+    }
+
+    g_ptr_array_sort(queue, pb_prefetch_cmp_cp);
+
+    pg->prefetch_queue = g_new(guint, MAX(queue->len, 1));
+    for (i = 0; i < queue->len; i++)
+        pg->prefetch_queue[i] = ((PBNode)g_ptr_array_index(queue, i))->id;
+    pg->prefetch_len = queue->len;
+    pg->prefetch_first = 0;
+
+    pb_log(PB_INFO, "===== Prefetching the sources of %u packages, %u at the same time\n",
+        pg->prefetch_len, pg->prefetch_max);
+
+    g_ptr_array_free(queue, TRUE);
+}
+
+/**
+ * @brief Start prefetching the sources of the first nodes of the queue whose host parents
+ * are built, while there are free places in the pool. The nodes that are being built
+ * or that were already built download their own sources, and the nodes blocked by a failed
+ * parent are never built, so they're skipped too.
+ * @param pg Main struct
+ */
+void pb_prefetch_start(PBMain pg)
+{
+    gchar   *target;
+    guint   i;
+
+    if (!pg->prefetch_max || pg->build_error)
+        return;
+
+    for (i = pg->prefetch_first; i < pg->prefetch_len && pg->prefetch_running < pg->prefetch_max; i++) {
+        PBNode  node = &pg->nodes[pg->prefetch_queue[i]];
+
+        if (node->prefetch == PB_PREFETCH_NONE &&
+                (node->status == PB_STATUS_PENDING || node->status == PB_STATUS_READY)) {
+            if (node->pending_host_parents > 0)
+                continue;
+
+            target = g_strdup_printf("%s-%s", node->package,
+                (pg->prefetch_extract && !node->steps) ? "extract" : "source");
+
+            if (pb_exec_start_prefetch(pg, node, target) == PB_OK) {
+                pb_debug(1, DBG_EXEC, "Prefetching '%s'\n", target);
+                node->prefetch = PB_PREFETCH_RUNNING;
+                pg->prefetch_running++;
+            }
+            else {
+                node->prefetch = PB_PREFETCH_FAILED;
+                pg->prefetch_failed++;
+            }
+
+            g_free(target);
+        }
+
+        /* The handled nodes at the start of the queue are never checked again */
+        if (i == pg->prefetch_first)
+            pg->prefetch_first++;
+    }
+}
+
+/**
+ * @brief Handle a prefetch process that exited. If it failed, the sources
+ * are downloaded again when the node is built, which reports the error if any.
+ * @param pg Main struct
+ * @param proc The finished process
+ * @return TRUE if the node was waiting for its sources to be built, FALSE otherwise
+ */
+gboolean pb_prefetch_finish(PBMain pg, PBProc proc)
+{
+    PBNode      node = proc->node;
+    gboolean    deferred = (node->prefetch == PB_PREFETCH_DEFERRED);
+
+    pg->prefetch_running--;
+
+    if (WIFEXITED(proc->status) && WEXITSTATUS(proc->status) == 0) {
+        pb_debug(1, DBG_EXEC, "Sources of '%s' prefetched\n", node->package);
+        node->prefetch = PB_PREFETCH_DONE;
+        pg->prefetch_done++;
+    }
+    else if (pg->prefetch_stopped) {
+        pb_debug(1, DBG_EXEC, "Prefetch of the sources of '%s' stopped\n", node->package);
+        node->prefetch = PB_PREFETCH_FAILED;
+    }
+    else {
+        pb_log(PB_WARN, "Failed to prefetch the sources of '%s'. They will be downloaded when it's built\n",
+            node->package);
+        node->prefetch = PB_PREFETCH_FAILED;
+        pg->prefetch_failed++;
+    }
+
+    return deferred;
+}
+
+/**
+ * @brief Kill the running prefetch processes once nothing else is going to be built, so
+ * pb_graph_exec() doesn't wait for downloads that won't be used. make passes the signal to
+ * the processes it started. The killed processes are still finished by pb_prefetch_finish().
+ * @param pg Main struct
+ */
+void pb_prefetch_stop(PBMain pg)
+{
+    guint   i;
+
+    if (!pg->prefetch_running || pg->prefetch_stopped)
+        return;
+
+    pg->prefetch_stopped = TRUE;
+
+    for (i = 0; i < pg->prefetch_len; i++) {
+        PBNode  node = &pg->nodes[pg->prefetch_queue[i]];
+
+        if (node->prefetch_proc && !node->prefetch_proc->exited) {
+            pb_debug(1, DBG_EXEC, "Stopping the prefetch of the sources of '%s'\n", node->package);
+            kill(node->prefetch_proc->pid, SIGTERM);
+        }
+    }
+}
+
+/**
+ * @brief Print how many packages were prefetched
+ * @param pg Main struct
+ */
+void pb_prefetch_print_summary(PBMain pg)
+{
+    if (!pg || !pg->prefetch_max)
+        return;
+
+    pb_log(PB_INFO, "===== Sources prefetched ahead of the build: %u packages, %u failed\n",
+        pg->prefetch_done, pg->prefetch_failed);
+}
+
+/**
+ * @brief Free the prefetch queue
+ * @param pg Main struct
+ */
+void pb_prefetch_free(PBMain pg)
+{
+    if (pg) {
+        g_free(pg->prefetch_queue);
+        pg->prefetch_queue = NULL;
+        pg->prefetch_len = 0;
+    }
+}
@@ -0,0 +1,24 @@
+/**
+ * @file prefetch.h
+ * @brief Download the sources of the packages ahead of their build
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include "graph_common.h"
+#include "executor.h"
+#include "utils.h"
+
+void        pb_prefetch_init(PBMain);
+void        pb_prefetch_start(PBMain);
+gboolean    pb_prefetch_finish(PBMain, PBProc);
+void        pb_prefetch_stop(PBMain);
+void        pb_prefetch_print_summary(PBMain);
+void        pb_prefetch_free(PBMain);
+
+#endif  /* _PREFETCH_H_ */
@@ -0,0 +1,124 @@
+/**
+ * @file rusage.c
+ * @brief Resources used by each package as returned by wait4(): CPU time, peak RSS,
+ * block I/O and context switches. The CPU time divided by the wall time tells how many
+ * cores a package used on average, so a ratio close to 1 means that it's built serially.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "rusage.h"
+
+/**
+ * @brief Store in a node the resources used by its make process and all its descendants
+ * @param node The node that was built
+ * @param ru The resources returned by wait4()
+ */
+void pb_rusage_set(PBNode node, const struct rusage *ru)
+{
+    node->utime_secs = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / (gdouble)G_USEC_PER_SEC;
+    node->stime_secs = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / (gdouble)G_USEC_PER_SEC;
+    node->maxrss_kb = ru->ru_maxrss;
+    node->inblock = ru->ru_inblock;
+    node->oublock = ru->ru_oublock;
+    node->nvcsw = ru->ru_nvcsw;
+    node->nivcsw = ru->ru_nivcsw;
+}
+
+static gint pb_rusage_cmp_elapsed(gconstpointer a, gconstpointer b)
+{
+    PBNode  node_a = *(PBNode *)a;
+    PBNode  node_b = *(PBNode *)b;
+
+    return (node_a->elapsed_secs < node_b->elapsed_secs) - (node_a->elapsed_secs > node_b->elapsed_secs);
+}
+
+/**
+ * @brief Append a line with the resources used by a node
+ * @param str Where the line is appended
+ * @param node A node built in this run
+ */
+static void pb_rusage_append_node(GString *str, PBNode node)
+{
+    gdouble cpu_secs = node->utime_secs + node->stime_secs;
+
+    g_string_append_printf(str, "%-32s %9.1f %9.1f %9.1f %6.2f %8.1f %10ld %10ld %9ld %9ld\n",
+        node->name, node->elapsed_secs, node->utime_secs, node->stime_secs,
+        (node->elapsed_secs > 0) ? cpu_secs / node->elapsed_secs : 0,
+        node->maxrss_kb / 1024.0, node->inblock, node->oublock, node->nvcsw, node->nivcsw);
+}
+
+/**
+ * @brief Print the resources used by the packages that took longer to build and the totals,
+ * and write the resources used by all the packages to pbuilder_logs/pbuilder_rusage.log
+ * @param pg Main struct
+ */
+void pb_rusage_print_summary(PBMain pg)
+{
+    GPtrArray   *built;
+    GString     *table,
+                *header;
+    GError      *error = NULL;
+    gchar       *path;
+    gdouble     cpu_secs = 0,
+                wall_secs = 0;
+    guint       i;
+
+    if (!pg)
+        return;
+
+    built = g_ptr_array_new();
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        /* Only the nodes built in this run have a start time */
+        if (!node->start_usecs || node->status != PB_STATUS_DONE)
+            continue;
+
+        g_ptr_array_add(built, node);
+        cpu_secs += node->utime_secs + node->stime_secs;
+        wall_secs += node->elapsed_secs;
+    }
+
+    if (!built->len) {
+        g_ptr_array_free(built, TRUE);
+        return;
+    }
+
+    g_ptr_array_sort(built, pb_rusage_cmp_elapsed);
+
+    header = g_string_new(NULL);
+    g_string_printf(header, "%-32s %9s %9s %9s %6s %8s %10s %10s %9s %9s\n",
+        "Package", "Wall(s)", "User(s)", "Sys(s)", "CPU/W", "RSS(MB)", "BlkIn", "BlkOut", "VolCS", "InvolCS");
+
+    /* The whole table goes to a file */
+    table = g_string_new(header->str);
+    for (i = 0; i < built->len; i++)
+        pb_rusage_append_node(table, g_ptr_array_index(built, i));
+
+    path = g_strdup_printf("%s/pbuilder_logs/%s", pg->env->config_dir, PB_RUSAGE_FILE);
+    if (!g_file_set_contents(path, table->str, table->len, &error)) {
+        pb_log(PB_WARN, "%s(): Failed to write %s: %s\n", __func__, path, error->message);
+        g_error_free(error);
+    }
+    g_free(path);
+
+    /* And only the longest ones to stdout */
+    g_string_assign(table, header->str);
+    for (i = 0; i < built->len && i < PB_RUSAGE_SUMMARY_TOP; i++)
+        pb_rusage_append_node(table, g_ptr_array_index(built, i));
+
+    pb_log(PB_INFO, "===== Resources used by the %u longest packages (all of them in pbuilder_logs/%s):\n",
+        MIN(built->len, PB_RUSAGE_SUMMARY_TOP), PB_RUSAGE_FILE);
+    printf("%s", table->str);
+    pb_log(PB_INFO, "===== CPU time: %.1f secs, packages wall time: %.1f secs, CPU/wall: %.2f, "
+        "CPU/total elapsed: %.2f\n", cpu_secs, wall_secs, (wall_secs > 0) ? cpu_secs / wall_secs : 0,
+        (pg->elapsed_secs > 0) ? cpu_secs / pg->elapsed_secs : 0);
+
+    g_string_free(table, TRUE);
+    g_string_free(header, TRUE);
+    g_ptr_array_free(built, TRUE);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file rusage.h
+ * @brief Resources used by each package
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _RUSAGE_H_
+#define _RUSAGE_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+/**
+ * File inside pbuilder_logs with the resources used by all the packages
+ */
+#define PB_RUSAGE_FILE              "pbuilder_rusage.log"
+
+/**
+ * Number of packages shown in the summary
+ */
+#define PB_RUSAGE_SUMMARY_TOP       20
+
+void        pb_rusage_set(PBNode, const struct rusage *);
+void        pb_rusage_print_summary(PBMain);
+
+#endif  /* _RUSAGE_H_ */
@@ -0,0 +1,275 @@
+/**
+ * @file sched.c
+ * @brief Built-in scheduling policies. Each one compares two ready nodes
+ * and decides which one has to be built first.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "sched.h"
+
+/**
+ * @brief Default order used by all the policies when two nodes are equivalent:
+ * the lowest priority first and then the order of the deps file
+ */
+static gboolean pb_sched_priority_before(PBMain pg, PBNode a, PBNode b)
+{
+    if (a->priority != b->priority)
+        return a->priority < b->priority;
+
+    return a->id < b->id;
+}
+
+static gboolean pb_sched_critical_path_before(PBMain pg, PBNode a, PBNode b)
+{
+    if (a->cp_secs != b->cp_secs)
+        return a->cp_secs > b->cp_secs;
+
+    return pb_sched_priority_before(pg, a, b);
+}
+
+static gboolean pb_sched_descendants_before(PBMain pg, PBNode a, PBNode b)
+{
+    if (a->descendants != b->descendants)
+        return a->descendants > b->descendants;
+
+    return pb_sched_priority_before(pg, a, b);
+}
+
+static gboolean pb_sched_fan_out_before(PBMain pg, PBNode a, PBNode b)
+{
+    guint   fan_out_a = pg->children_off[a->id + 1] - pg->children_off[a->id],
+            fan_out_b = pg->children_off[b->id + 1] - pg->children_off[b->id];
+
+    if (fan_out_a != fan_out_b)
+        return fan_out_a > fan_out_b;
+
+    return pb_sched_priority_before(pg, a, b);
+}
+
+/**
+ * @brief First ready, first built, where each priority level counts as PB_SCHED_AGING_USECS
+ * of waiting. Shallow nodes overtake the deep ones that became ready shortly before them,
+ * but a node that has waited long enough is always built, so no node starves.
+ * All the ready nodes age at the same rate, so the order doesn't change while they wait.
+ */
+static gboolean pb_sched_fifo_aging_before(PBMain pg, PBNode a, PBNode b)
+{
+    gint64  key_a = a->ready_usecs + (gint64)a->priority * PB_SCHED_AGING_USECS,
+            key_b = b->ready_usecs + (gint64)b->priority * PB_SCHED_AGING_USECS;
+
+    if (key_a != key_b)
+        return key_a < key_b;
+
+    return pb_sched_priority_before(pg, a, b);
+}
+
+/**
+ * @brief Count the descendants of each node, that is, the nodes that can't be built until it is.
+ * The descendants of a node can't be added from its children since they share descendants,
+ * so the reachable nodes are calculated as bitmasks, 64 target nodes at a time, visiting
+ * the nodes in reverse priority order so the children are always visited first.
+ * @param pg Main struct
+ */
+static void pb_sched_count_descendants(PBMain pg)
+{
+    guint64 *mask;
+    guint   base,
+            i,
+            j;
+    gint    k;
+
+    mask = g_new(guint64, pg->nodes_num);
+
+    for (i = 0; i < pg->nodes_num; i++)
+        pg->nodes[i].descendants = 0;
+
+    for (base = 0; base < pg->nodes_num; base += 64) {
+        for (k = pg->nodes_num - 1; k >= 0; k--) {
+            guint   id = pg->sorted[k];
+            guint64 reach = 0;
+
+            for (j = pg->children_off[id]; j < pg->children_off[id + 1]; j++) {
+                guint   child = pg->children[j];
+
+                reach |= mask[child];
+                if (child >= base && child < base + 64)
+                    reach |= G_GUINT64_CONSTANT(1) << (child - base);
+            }
+
+            mask[id] = reach;
+            pg->nodes[id].descendants += __builtin_popcountll(reach);
+        }
+    }
+
+    g_free(mask);
+
+    pb_debug(1, DBG_CREATE, "The root has %u descendants\n", pg->nodes[0].descendants);
+}
+
+static const struct pbuilder_sched_policy_st pb_sched_policies[] =
+{
+    { "priority",       "Lowest dependency depth first",
+        NULL,                       pb_sched_priority_before },
+    { "critical-path",  "Longest expected time to the end of the graph first",
+        NULL,                       pb_sched_critical_path_before },
+    { "descendants",    "Most packages waiting for it first",
+        pb_sched_count_descendants, pb_sched_descendants_before },
+    { "fan-out",        "Most children first",
+        NULL,                       pb_sched_fan_out_before },
+    { "fifo-aging",     "First ready first built, each level of depth counts as a minute of waiting",
+        NULL,                       pb_sched_fifo_aging_before },
+    { NULL }
+};
+
+/**
+ * @brief Find a scheduling policy by name
+ * @param name The policy name
+ * @return The policy or NULL if there's no policy with that name
+ */
+PBSchedPolicy pb_sched_find(const gchar *name)
+{
+    const struct pbuilder_sched_policy_st *policy;
+
+    for (policy = pb_sched_policies; policy->name; policy++)
+        if (!g_strcmp0(policy->name, name))
+            return policy;
+
+    return NULL;
+}
+
+/**
+ * @brief Get the names of all the policies separated by commas
+ * @return A GString that must be freed
+ */
+GString * pb_sched_list_names(void)
+{
+    const struct pbuilder_sched_policy_st *policy;
+    GString *names = g_string_new(NULL);
+
+    for (policy = pb_sched_policies; policy->name; policy++)
+        g_string_append_printf(names, "%s%s", (policy == pb_sched_policies) ? "" : ", ", policy->name);
+
+    return names;
+}
+
+/**
+ * @brief Calculate the node data used by the selected policy
+ * @param pg Main struct
+ */
+void pb_sched_init(PBMain pg)
+{
+    if (!pg || !pg->policy)
+        return;
+
+    pb_debug(1, DBG_CREATE, "Scheduling policy: %s (%s)\n", pg->policy->name, pg->policy->desc);
+
+    if (pg->policy->init)
+        pg->policy->init(pg);
+}
+
+/**
+ * @brief Add an id to a binary heap
+ * @param heap The heap
+ * @param num Number of ids in the heap
+ * @param id The id
+ * @param before Order of the heap: TRUE if the first id has to be on top of the second one
+ * @param data Passed to before()
+ */
+void pb_sched_heap_push(guint *heap, guint *num, guint id, PBSchedBefore before, gconstpointer data)
+{
+    guint   pos = (*num)++,
+            parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!before(data, id, heap[parent]))
+            break;
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+
+    heap[pos] = id;
+}
+
+/**
+ * @brief Remove the id on top of a binary heap, which must not be empty
+ * @param heap The heap
+ * @param num Number of ids in the heap
+ * @param before Order of the heap: TRUE if the first id has to be on top of the second one
+ * @param data Passed to before()
+ * @return The id
+ */
+guint pb_sched_heap_pop(guint *heap, guint *num, PBSchedBefore before, gconstpointer data)
+{
+    guint   top = heap[0],
+            last = heap[--(*num)],
+            pos = 0,
+            child;
+
+    while ((child = 2 * pos + 1) < *num) {
+        if (child + 1 < *num && before(data, heap[child + 1], heap[child]))
+            child++;
+        if (!before(data, heap[child], last))
+            break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+
+    heap[pos] = last;
+
+    return top;
+}
+
+/**
+ * @brief Compare two nodes of the ready heap using the scheduling policy
+ * @param data Main struct
+ * @param a Id of the first node
+ * @param b Id of the second node
+ * @return TRUE if the first node has to be built before the second one
+ */
+static gboolean pb_sched_ready_before(gconstpointer data, guint a, guint b)
+{
+    PBMain  pg = (PBMain)data;
+
+    return pg->policy->before(pg, &pg->nodes[a], &pg->nodes[b]);
+}
+
+/**
+ * @brief Add a node whose parents are all built to the ready heap of the main struct.
+ * Both the real and the simulated builds use it, so they order the ready nodes the same way.
+ * @param pg Main struct
+ * @param node The node that is ready to be built
+ * @param now_usecs Current time, real or virtual
+ * @return TRUE if the node became ready now, FALSE if it was already ready, e.g. it waited
+ * for its sources to be prefetched
+ */
+gboolean pb_sched_ready_push(PBMain pg, PBNode node, gint64 now_usecs)
+{
+    gboolean    became_ready = FALSE;
+
+    if (node->status != PB_STATUS_READY || !node->ready_usecs) {
+        node->status = PB_STATUS_READY;
+        node->ready_usecs = now_usecs;
+        became_ready = TRUE;
+    }
+
+    pb_sched_heap_push(pg->ready_heap, &pg->ready_num, node->id, pb_sched_ready_before, pg);
+
+    return became_ready;
+}
+
+/**
+ * @brief Remove from the ready heap of the main struct the node that has to be built first
+ * @param pg Main struct
+ * @return The node or NULL if there are no ready nodes
+ */
+PBNode pb_sched_ready_pop(PBMain pg)
+{
+    if (!pg->ready_num)
+        return NULL;
+
+    return &pg->nodes[pb_sched_heap_pop(pg->ready_heap, &pg->ready_num, pb_sched_ready_before, pg)];
+}
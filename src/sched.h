@@ -0,0 +1,49 @@
+/**
+ * @file sched.h
+ * @brief Scheduling policies that decide which ready node is built first
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+#define SCHED_DEFAULT           "priority"
+
+/**
+ * Waiting time that is worth one priority level in the fifo-aging policy
+ */
+#define PB_SCHED_AGING_USECS    (60 * G_USEC_PER_SEC)
+
+/**
+ * A scheduling policy. The ready heap keeps on top the node that has to be built before
+ * all the others according to before(), so before() must define a strict total order
+ * that doesn't change while the node is in the heap.
+ */
+struct pbuilder_sched_policy_st
+{
+    const gchar     *name;              /**< Name used in the cmdline */
+    const gchar     *desc;              /**< Short description */
+    void            (*init)(PBMain);    /**< Calculate the node data used by before(). Optional */
+    gboolean        (*before)(PBMain, PBNode, PBNode); /**< TRUE if the first node has to be built first */
+};
+
+/**
+ * Order of a binary heap of ids: TRUE if the first id has to be on top of the second one
+ */
+typedef gboolean (*PBSchedBefore)(gconstpointer, guint, guint);
+
+PBSchedPolicy   pb_sched_find(const gchar *);
+GString *       pb_sched_list_names(void);
+void            pb_sched_init(PBMain);
+void            pb_sched_heap_push(guint *, guint *, guint, PBSchedBefore, gconstpointer);
+guint           pb_sched_heap_pop(guint *, guint *, PBSchedBefore, gconstpointer);
+gboolean        pb_sched_ready_push(PBMain, PBNode, gint64);
+PBNode          pb_sched_ready_pop(PBMain);
+
+#endif  /* _SCHED_H_ */
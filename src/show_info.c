@@ -0,0 +1,594 @@
+/**
+ * @file show_info.c
+ * @brief Create the graph straight from the JSON printed by Buildroot's 'make show-info',
+ * read from a file, from stdin or from a pipe to 'make show-info' itself.
+ * The JSON is parsed while it's read, so only the fields used by pbuilder are kept:
+ * the name, version, type, build system, install directories and dependencies of each package.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+
+#include "show_info.h"
+#include "graph_create.h"
+
+extern char **environ;
+
+/**
+ * Fields of a package used by pbuilder. All the other fields are skipped
+ */
+typedef enum
+{
+    PB_FIELD_OTHER,
+    PB_FIELD_NAME,
+    PB_FIELD_VERSION,
+    PB_FIELD_TYPE,
+    PB_FIELD_BUILD_SYSTEM,
+    PB_FIELD_INSTALL_TARGET,
+    PB_FIELD_INSTALL_STAGING,
+    PB_FIELD_INSTALL_IMAGES,
+    PB_FIELD_DEPENDENCIES
+} PBField;
+
+/**
+ * The JSON input being parsed
+ */
+typedef struct
+{
+    FILE            *fd;                /**< Input stream */
+    guint           line;               /**< Current line, used in the error messages */
+    GString         *str;               /**< Last string read */
+} PBJson;
+
+static gint pb_json_getc(PBJson *js)
+{
+    gint    c = getc_unlocked(js->fd);
+
+    if (c == '\n')
+        js->line++;
+
+    return c;
+}
+
+/**
+ * @brief Skip the white spaces and get the next char without consuming it
+ * @param js The JSON input
+ * @return The next char or EOF
+ */
+static gint pb_json_peek(PBJson *js)
+{
+    gint    c;
+
+    do {
+        c = pb_json_getc(js);
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+    if (c != EOF)
+        ungetc(c, js->fd);
+
+    return c;
+}
+
+static PBResult pb_json_error(PBJson *js, const gchar *expected)
+{
+    gint    c = pb_json_peek(js);
+
+    if (c == EOF)
+        pb_log(PB_ERR, "show-info: line %u: Expected %s but the input ended\n", js->line, expected);
+    else
+        pb_log(PB_ERR, "show-info: line %u: Expected %s but found '%c'\n", js->line, expected, c);
+
+    return PB_FAIL;
+}
+
+static PBResult pb_json_expect(PBJson *js, gchar c, const gchar *expected)
+{
+    if (pb_json_peek(js) != c)
+        return pb_json_error(js, expected);
+
+    pb_json_getc(js);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Read a string and store it unescaped in js->str
+ * @param js The JSON input
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_json_read_string(PBJson *js)
+{
+    gunichar    uc;
+    gint        c,
+                digit,
+                i;
+
+    if (pb_json_expect(js, '"', "a string") != PB_OK)
+        return PB_FAIL;
+
+    g_string_truncate(js->str, 0);
+
+    while ((c = pb_json_getc(js)) != '"') {
+        if (c == EOF || c == '\n') {
+            pb_log(PB_ERR, "show-info: line %u: Unterminated string\n", js->line);
+            return PB_FAIL;
+        }
+
+        if (c != '\\') {
+            g_string_append_c(js->str, c);
+            continue;
+        }
+
+        switch ((c = pb_json_getc(js))) {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            case 'b':
+                c = '\b';
+                break;
+            case 'f':
+                c = '\f';
+                break;
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case 'u':
+                for (uc = 0, i = 0; i < 4; i++) {
+                    if ((digit = g_ascii_xdigit_value(pb_json_getc(js))) < 0) {
+                        pb_log(PB_ERR, "show-info: line %u: Invalid unicode escape\n", js->line);
+                        return PB_FAIL;
+                    }
+                    uc = (uc << 4) | digit;
+                }
+                g_string_append_unichar(js->str, uc);
+                continue;
+            default:
+                pb_log(PB_ERR, "show-info: line %u: Invalid escape sequence\n", js->line);
+                return PB_FAIL;
+        }
+
+        g_string_append_c(js->str, c);
+    }
+
+    return PB_OK;
+}
+
+/**
+ * @brief Read true, false or null
+ * @param js The JSON input
+ * @param value Where TRUE is stored if the literal is true, FALSE otherwise
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_json_read_literal(PBJson *js, gboolean *value)
+{
+    const gchar *literal,
+                *p;
+
+    switch (pb_json_peek(js)) {
+        case 't':
+            literal = "true";
+            break;
+        case 'f':
+            literal = "false";
+            break;
+        case 'n':
+            literal = "null";
+            break;
+        default:
+            return pb_json_error(js, "a value");
+    }
+
+    for (p = literal; *p; p++) {
+        if (pb_json_getc(js) != *p) {
+            pb_log(PB_ERR, "show-info: line %u: Invalid literal, expected '%s'\n", js->line, literal);
+            return PB_FAIL;
+        }
+    }
+
+    *value = (*literal == 't');
+
+    return PB_OK;
+}
+
+static PBResult pb_json_skip_number(PBJson *js)
+{
+    gint    c,
+            len = 0;
+
+    while ((c = getc_unlocked(js->fd)) != EOF && strchr("+-0123456789.eE", c))
+        len++;
+
+    if (c != EOF)
+        ungetc(c, js->fd);
+
+    return len ? PB_OK : pb_json_error(js, "a value");
+}
+
+/**
+ * @brief Skip a value of any type, including nested objects and arrays
+ * @param js The JSON input
+ * @param depth Nesting level of the value
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_json_skip_value(PBJson *js, guint depth)
+{
+    gboolean    value;
+    gint        c,
+                close;
+
+    if (depth > PB_SHOW_INFO_MAX_DEPTH) {
+        pb_log(PB_ERR, "show-info: line %u: Values nested too deep\n", js->line);
+        return PB_FAIL;
+    }
+
+    switch ((c = pb_json_peek(js))) {
+        case '"':
+            return pb_json_read_string(js);
+        case 't':
+        case 'f':
+        case 'n':
+            return pb_json_read_literal(js, &value);
+        case '{':
+        case '[':
+            break;
+        default:
+            return pb_json_skip_number(js);
+    }
+
+    close = (c == '{') ? '}' : ']';
+    pb_json_getc(js);
+
+    if (pb_json_peek(js) == close) {
+        pb_json_getc(js);
+        return PB_OK;
+    }
+
+    for (;;) {
+        if (c == '{' && (pb_json_read_string(js) != PB_OK || pb_json_expect(js, ':', "':'") != PB_OK))
+            return PB_FAIL;
+
+        if (pb_json_skip_value(js, depth + 1) != PB_OK)
+            return PB_FAIL;
+
+        if (pb_json_peek(js) != ',')
+            break;
+        pb_json_getc(js);
+    }
+
+    return pb_json_expect(js, close, (close == '}') ? "',' or '}'" : "',' or ']'");
+}
+
+static PBField pb_show_info_field(const gchar *key)
+{
+    static const struct { const gchar *key; PBField field; } fields[] =
+    {
+        { "name",               PB_FIELD_NAME },
+        { "version",            PB_FIELD_VERSION },
+        { "type",               PB_FIELD_TYPE },
+        { "build_system",       PB_FIELD_BUILD_SYSTEM },
+        { "install_target",     PB_FIELD_INSTALL_TARGET },
+        { "install_staging",    PB_FIELD_INSTALL_STAGING },
+        { "install_images",     PB_FIELD_INSTALL_IMAGES },
+        { "dependencies",       PB_FIELD_DEPENDENCIES },
+    };
+    guint   i;
+
+    for (i = 0; i < G_N_ELEMENTS(fields); i++)
+        if (!strcmp(fields[i].key, key))
+            return fields[i].field;
+
+    return PB_FIELD_OTHER;
+}
+
+/**
+ * @brief Read the dependencies of a package and intern them in the names arena
+ * @param js The JSON input
+ * @param pg Main struct
+ * @param parents Where the interned names are added
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_show_info_read_deps(PBJson *js, PBMain pg, GPtrArray *parents)
+{
+    if (pb_json_peek(js) != '[')
+        return pb_json_skip_value(js, 2);
+
+    pb_json_getc(js);
+
+    if (pb_json_peek(js) == ']') {
+        pb_json_getc(js);
+        return PB_OK;
+    }
+
+    for (;;) {
+        if (pb_json_read_string(js) != PB_OK)
+            return PB_FAIL;
+
+        if (js->str->len > 0)
+            g_ptr_array_add(parents, g_string_chunk_insert_const(pg->names, js->str->str));
+
+        if (pb_json_peek(js) != ',')
+            break;
+        pb_json_getc(js);
+    }
+
+    return pb_json_expect(js, ']', "',' or ']'");
+}
+
+/**
+ * @brief Read a package and create its node. As in pbuilder.py, the entries without
+ * a name are not packages and are skipped, and the node is named after the entry key.
+ * @param js The JSON input
+ * @param b The graph builder
+ * @param key The entry key
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_show_info_read_package(PBJson *js, PBGraphBuilder b, const gchar *key)
+{
+    GPtrArray   *parents;
+    const gchar *version = "",
+                *type = "",
+                *build_system = "";
+    gboolean    has_name = FALSE,
+                value;
+    PBInstall   install = 0,
+                flag;
+    PBField     field;
+    PBNode      node;
+    PBResult    ret = PB_OK;
+    guint       i;
+
+    pb_json_getc(js);
+
+    if (pb_json_peek(js) == '}') {
+        pb_json_getc(js);
+        return PB_OK;
+    }
+
+    parents = g_ptr_array_new();
+
+    while (ret == PB_OK) {
+        if (pb_json_read_string(js) != PB_OK || pb_json_expect(js, ':', "':'") != PB_OK) {
+            ret = PB_FAIL;
+            break;
+        }
+
+        field = pb_show_info_field(js->str->str);
+
+        switch (field) {
+            case PB_FIELD_NAME:
+            case PB_FIELD_VERSION:
+            case PB_FIELD_TYPE:
+            case PB_FIELD_BUILD_SYSTEM:
+                /* Missing values are null */
+                if (pb_json_peek(js) != '"') {
+                    ret = pb_json_skip_value(js, 2);
+                    break;
+                }
+
+                if ((ret = pb_json_read_string(js)) != PB_OK)
+                    break;
+
+                g_strstrip(js->str->str);
+
+                if (field == PB_FIELD_NAME)
+                    has_name = (js->str->str[0] != '\0');
+                else if (field == PB_FIELD_VERSION)
+                    version = g_string_chunk_insert_const(b->pg->names, js->str->str);
+                else if (field == PB_FIELD_TYPE)
+                    type = g_string_chunk_insert_const(b->pg->names, js->str->str);
+                else
+                    build_system = g_string_chunk_insert_const(b->pg->names, js->str->str);
+                break;
+            case PB_FIELD_INSTALL_TARGET:
+            case PB_FIELD_INSTALL_STAGING:
+            case PB_FIELD_INSTALL_IMAGES:
+                if ((ret = pb_json_read_literal(js, &value)) != PB_OK)
+                    break;
+
+                flag = (field == PB_FIELD_INSTALL_TARGET) ? PB_INSTALL_TARGET :
+                    (field == PB_FIELD_INSTALL_STAGING) ? PB_INSTALL_STAGING : PB_INSTALL_IMAGES;
+                if (value)
+                    install |= flag;
+                break;
+            case PB_FIELD_DEPENDENCIES:
+                ret = pb_show_info_read_deps(js, b->pg, parents);
+                break;
+            default:
+                ret = pb_json_skip_value(js, 2);
+                break;
+        }
+
+        if (ret != PB_OK)
+            break;
+
+        if (pb_json_peek(js) != ',') {
+            ret = pb_json_expect(js, '}', "',' or '}'");
+            break;
+        }
+        pb_json_getc(js);
+    }
+
+    if (ret == PB_OK && has_name) {
+        pb_debug(2, DBG_CREATE, "Parsing %s\n", key);
+
+        if ((node = pb_graph_builder_add_node(b, key, version)) != NULL) {
+            node->type = type;
+            node->build_system = build_system;
+            node->install = install;
+
+            for (i = 0; i < parents->len; i++)
+                pb_graph_builder_add_parent(b, g_ptr_array_index(parents, i));
+        }
+    }
+    else if (ret == PB_OK)
+        pb_debug(2, DBG_CREATE, "Skipping %s\n", key);
+
+    g_ptr_array_free(parents, TRUE);
+
+    return ret;
+}
+
+/**
+ * @brief Read the top-level object, whose members are the packages indexed by name
+ * @param js The JSON input
+ * @param b The graph builder
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_show_info_parse(PBJson *js, PBGraphBuilder b)
+{
+    gchar       *key;
+    PBResult    ret = PB_OK;
+
+    if (pb_json_expect(js, '{', "'{'") != PB_OK)
+        return PB_FAIL;
+
+    if (pb_json_peek(js) == '}')
+        pb_json_getc(js);
+    else {
+        while (ret == PB_OK) {
+            if (pb_json_read_string(js) != PB_OK || pb_json_expect(js, ':', "':'") != PB_OK)
+                return PB_FAIL;
+
+            key = g_strdup(js->str->str);
+
+            if (pb_json_peek(js) == '{')
+                ret = pb_show_info_read_package(js, b, key);
+            else
+                ret = pb_json_skip_value(js, 1);
+
+            g_free(key);
+
+            if (ret != PB_OK)
+                break;
+
+            if (pb_json_peek(js) != ',') {
+                ret = pb_json_expect(js, '}', "',' or '}'");
+                break;
+            }
+            pb_json_getc(js);
+        }
+    }
+
+    if (ret == PB_OK && pb_json_peek(js) != EOF)
+        ret = pb_json_error(js, "the end of the input");
+
+    return ret;
+}
+
+/**
+ * @brief Get the file the JSON is read from: the one given in the cmdline or, with "make",
+ * the one where the output of 'make show-info' is saved by pb_show_info_run_make()
+ * @param pg Main struct
+ * @return The path, to be freed by the caller, or NULL if the JSON is read from stdin
+ */
+gchar * pb_show_info_get_path(PBMain pg)
+{
+    if (!g_strcmp0(show_info, PB_SHOW_INFO_STDIN))
+        return NULL;
+
+    if (!g_strcmp0(show_info, PB_SHOW_INFO_MAKE))
+        return g_strdup_printf("%s/%s", pg->env->config_dir, PB_SHOW_INFO_MAKE_FILE);
+
+    return g_strdup(show_info);
+}
+
+/**
+ * @brief Run 'make show-info' with its stdout saved in the file given by pb_show_info_get_path(),
+ * so the graph cache can hash it and the graph is created from it only on a cache miss.
+ * Its stderr is not redirected, so its errors are shown as they happen.
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_show_info_run_make(PBMain pg)
+{
+    posix_spawn_file_actions_t  actions;
+    gchar       *argv[] = { "make", "-s", "--no-print-directory", "show-info", NULL };
+    gchar       *path;
+    pid_t       pid;
+    gint        status = -1,
+                ret;
+
+    path = pb_show_info_get_path(pg);
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    ret = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (ret != 0) {
+        pb_log(PB_ERR, "%s(): posix_spawnp(): make show-info: %s\n", __func__, strerror(ret));
+        g_free(path);
+        return PB_FAIL;
+    }
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        pb_log(PB_ERR, "%s(): 'make show-info' failed\n", __func__);
+        /* A partial output must not be hashed or parsed by the next runs */
+        unlink(path);
+        g_free(path);
+        return PB_FAIL;
+    }
+
+    pb_debug(1, DBG_CREATE, "Saved the output of 'make show-info' in %s\n", path);
+    g_free(path);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Create a node of the graph for each package given by 'make show-info'
+ * and link it to its parents and children. The JSON is read from the file given
+ * in the cmdline, from stdin if it's "-" or from the output of 'make show-info' if it's "make",
+ * which must have been run by pb_show_info_run_make().
+ * @param pg Main struct
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_show_info_load(PBMain pg)
+{
+    struct pbuilder_graph_builder_st b;
+    PBJson      js = { NULL, 1, NULL };
+    gchar       *path;
+    PBResult    ret;
+
+    pb_debug(2, DBG_CREATE, "-----\nCreate each single node from show-info\n-----\n");
+
+    if ((path = pb_show_info_get_path(pg)) == NULL)
+        js.fd = stdin;
+    else if ((js.fd = fopen(path, "r")) == NULL)
+        pb_log(PB_ERR, "%s(): fopen(): %s: %s\n", __func__, path, strerror(errno));
+
+    g_free(path);
+
+    if (!js.fd)
+        return PB_FAIL;
+
+    pb_graph_builder_init(&b, pg, PB_SHOW_INFO_NAMES_SIZE);
+
+    js.str = g_string_new(NULL);
+    ret = pb_show_info_parse(&js, &b);
+    g_string_free(js.str, TRUE);
+
+    if (js.fd != stdin)
+        fclose(js.fd);
+
+    pb_debug(1, DBG_CREATE, "Packages read from show-info: %u\n", b.nodes->len - 1);
+
+    return pb_graph_builder_finish(&b, ret);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file show_info.h
+ * @brief Create the graph from the JSON printed by Buildroot's 'make show-info'
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _SHOW_INFO_H_
+#define _SHOW_INFO_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+/**
+ * Value of the show-info option that runs 'make show-info' instead of reading a file
+ */
+#define PB_SHOW_INFO_MAKE           "make"
+
+/**
+ * File in CONFIG_DIR where the output of 'make show-info' is saved
+ */
+#define PB_SHOW_INFO_MAKE_FILE      ".pbuilder.show-info"
+
+/**
+ * Value of the show-info option that reads the JSON from stdin
+ */
+#define PB_SHOW_INFO_STDIN          "-"
+
+/**
+ * Max nesting of the JSON values, deeper values are considered an error
+ */
+#define PB_SHOW_INFO_MAX_DEPTH      32
+
+/**
+ * Expected size of the names and versions when the size of the input is unknown
+ */
+#define PB_SHOW_INFO_NAMES_SIZE     (64 * BUFF_1K)
+
+gchar *     pb_show_info_get_path(PBMain);
+PBResult    pb_show_info_run_make(PBMain);
+PBResult    pb_show_info_load(PBMain);
+
+#endif  /* _SHOW_INFO_H_ */
@@ -0,0 +1,327 @@
+/**
+ * @file sim.c
+ * @brief Simulate the build of the graph in virtual time instead of running make. The ready nodes
+ * are ordered by the same scheduling policy and built in the same number of slots as in a real build,
+ * but each node takes the time given by the history, a timing file or a synthetic distribution.
+ * It shows the makespan, the slot utilization and the critical path, so the scheduling policies
+ * and the number of CPUs can be compared in seconds without building anything.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include <math.h>
+
+#include "sim.h"
+
+typedef struct pbuilder_sim_st * PBSim;
+
+/**
+ * Simulation state
+ */
+struct pbuilder_sim_st
+{
+    PBMain          pg;                 /**< Main struct */
+    gdouble         *ready_secs;        /**< Virtual time when each node became ready */
+    gdouble         *end;               /**< Virtual time when each running node is done */
+    guint           *running;           /**< Heap of the running nodes, ordered by their end time */
+    guint           running_num;        /**< Number of running nodes */
+};
+
+/**
+ * @brief Order of the heap of the running nodes: the first one to be done on top
+ */
+static gboolean pb_sim_running_before(gconstpointer data, guint a, guint b)
+{
+    PBSim   sim = (PBSim)data;
+
+    if (sim->end[a] != sim->end[b])
+        return sim->end[a] < sim->end[b];
+
+    return a < b;
+}
+
+/**
+ * @brief Set the building times of a log-normal distribution: "lognormal[:MEDIAN[:SIGMA]]"
+ * @param pg Main struct
+ * @param params The parameters after the name of the distribution
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_sim_set_lognormal(PBMain pg, const gchar *params)
+{
+    gdouble median = PB_SIM_LOGNORMAL_MEDIAN,
+            sigma = PB_SIM_LOGNORMAL_SIGMA;
+    gchar   *end;
+    GRand   *rand;
+    guint   i;
+
+    if (*params == ':') {
+        median = g_ascii_strtod(params + 1, &end);
+        if (*end == ':')
+            sigma = g_ascii_strtod(end + 1, &end);
+        if (*end != '\0' || median <= 0 || sigma < 0) {
+            pb_log(PB_ERR, "%s(): Invalid log-normal distribution '%s'. Format: %s[:MEDIAN[:SIGMA]]\n",
+                __func__, params + 1, PB_SIM_LOGNORMAL);
+            return PB_FAIL;
+        }
+    }
+
+    rand = g_rand_new_with_seed(PB_SIM_SEED);
+
+    /* Box-Muller transform of two uniform values into a normal one */
+    for (i = 1; i < pg->nodes_num; i++) {
+        gdouble u1 = 1.0 - g_rand_double(rand),
+                u2 = g_rand_double(rand);
+
+        pg->nodes[i].weight_secs = median * exp(sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * G_PI * u2));
+    }
+
+    g_rand_free(rand);
+
+    pb_log(PB_INFO, "Simulated building times: log-normal distribution with a median of %.1f secs and a sigma of %.2f\n",
+        median, sigma);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Set the building times of a file where each line has a package name and its time in seconds.
+ * The nodes that are not in the file keep the time expected from the history.
+ * @param pg Main struct
+ * @param path The timing file
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_sim_set_file(PBMain pg, const gchar *path)
+{
+    FILE        *fd;
+    gchar       line[BUFF_1K],
+                name[BUFF_1K];
+    gdouble     secs;
+    gboolean    *found;
+    PBNode      node;
+    guint       found_num = 0;
+
+    if ((fd = fopen(path, "r")) == NULL) {
+        pb_log(PB_ERR, "%s(): fopen(): %s: %s\n", __func__, path, strerror(errno));
+        return PB_FAIL;
+    }
+
+    found = g_new0(gboolean, pg->nodes_num);
+
+    while (fgets(line, sizeof(line), fd)) {
+        if (line[0] == '#')
+            continue;
+
+        if (sscanf(line, "%1023s %lf", name, &secs) != 2 || secs < 0) {
+            pb_debug(1, DBG_EXEC, "Ignoring invalid timing line: %s", line);
+            continue;
+        }
+
+        if ((node = pb_node_find_by_name(pg, name)) != NULL && node->id > 0) {
+            if (!found[node->id]) {
+                found[node->id] = TRUE;
+                found_num++;
+            }
+            node->weight_secs = secs;
+        }
+    }
+    fclose(fd);
+    g_free(found);
+
+    pb_log(PB_INFO, "Simulated building times: %u packages from %s, %u from the history\n",
+        found_num, path, pg->nodes_num - 1 - found_num);
+
+    return PB_OK;
+}
+
+/**
+ * @brief Set the simulated building time of each node as its expected time, so the scheduling
+ * policies know it in advance as if the history was exact, and calculate the critical path again
+ * @param pg Main struct
+ * @param source "history", "lognormal[:MEDIAN[:SIGMA]]" or a timing file
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+static PBResult pb_sim_set_times(PBMain pg, const gchar *source)
+{
+    PBResult    ret;
+
+    if (!g_strcmp0(source, PB_SIM_HISTORY)) {
+        pb_log(PB_INFO, "Simulated building times: expected times from the history\n");
+        return PB_OK;
+    }
+
+    if (!g_strcmp0(source, PB_SIM_LOGNORMAL) || g_str_has_prefix(source, PB_SIM_LOGNORMAL ":"))
+        ret = pb_sim_set_lognormal(pg, source + strlen(PB_SIM_LOGNORMAL));
+    else
+        ret = pb_sim_set_file(pg, source);
+
+    if (ret == PB_OK)
+        pb_graph_calc_critical_path(pg);
+
+    return ret;
+}
+
+/**
+ * @brief Print the critical path: the path from the root to a leaf
+ * that follows the child with the longest expected time to the end
+ * @param pg Main struct
+ */
+static void pb_sim_print_critical_path(PBMain pg)
+{
+    GString *path;
+    guint   id,
+            next,
+            num = 0,
+            i;
+
+    path = g_string_new(NULL);
+
+    for (id = 0; pg->children_off[id] < pg->children_off[id + 1]; id = next) {
+        next = pg->children[pg->children_off[id]];
+        for (i = pg->children_off[id] + 1; i < pg->children_off[id + 1]; i++)
+            if (pg->nodes[pg->children[i]].cp_secs > pg->nodes[next].cp_secs)
+                next = pg->children[i];
+
+        g_string_append_printf(path, "%s%s", num++ ? " -> " : "", pg->nodes[next].name);
+    }
+
+    pb_log(PB_INFO, "Critical path: %.3f secs, %u packages: %s\n", pg->nodes[0].cp_secs, num, path->str);
+
+    g_string_free(path, TRUE);
+}
+
+/**
+ * @brief Build the graph in virtual time: the ready nodes are started in the free slots
+ * in the order given by the scheduling policy and the virtual time jumps to the end of
+ * the first running node, whose children may become ready then.
+ * The adaptive slots, the memory budget and the prefetch pool are not simulated.
+ * @param pg Main struct
+ * @param source Building times: "history", "lognormal[:MEDIAN[:SIGMA]]" or a timing file
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_sim_run(PBMain pg, const gchar *source)
+{
+    struct pbuilder_sim_st sim;
+    gdouble     now = 0,
+                work = 0,
+                wait = 0,
+                max_wait = 0,
+                cp_secs,
+                bound;
+    guint       max_wait_id = 0,
+                max_running = 0,
+                built = 0,
+                id,
+                i,
+                j;
+    PBResult    ret = PB_OK;
+
+    if (!pg || !pg->nodes)
+        return PB_FAIL;
+
+    sim.pg = pg;
+    sim.ready_secs = g_new0(gdouble, pg->nodes_num);
+    sim.end = g_new0(gdouble, pg->nodes_num);
+    sim.running = g_new(guint, pg->nodes_num);
+    sim.running_num = 0;
+
+    /* The ready nodes are ordered by the same heap as in a real build */
+    g_free(pg->ready_heap);
+    pg->ready_heap = g_new(guint, pg->nodes_num);
+    pg->ready_num = 0;
+
+    if (pb_sim_set_times(pg, source) != PB_OK) {
+        ret = PB_FAIL;
+        goto out;
+    }
+
+    pb_log(PB_INFO, "===== Simulating the build of %u packages in %u slots with the '%s' scheduling policy\n",
+        pg->nodes_num - 1, pg->slots, pg->policy->name);
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        node->pending_parents = 0;
+        for (j = pg->parents_off[i]; j < pg->parents_off[i + 1]; j++)
+            if (pg->parents[j] != 0)
+                node->pending_parents++;
+
+        node->ready_usecs = 0;
+        if (node->pending_parents)
+            node->status = PB_STATUS_PENDING;
+        else
+            pb_sched_ready_push(pg, node, 0);
+        work += node->weight_secs;
+    }
+
+    while (TRUE) {
+        while (sim.running_num < pg->slots && pg->ready_num) {
+            PBNode  node = pb_sched_ready_pop(pg);
+            gdouble waited = now - sim.ready_secs[node->id];
+
+            node->status = PB_STATUS_PROCESSING;
+            sim.end[node->id] = now + node->weight_secs;
+            pb_sched_heap_push(sim.running, &sim.running_num, node->id, pb_sim_running_before, &sim);
+            max_running = MAX(max_running, sim.running_num);
+
+            wait += waited;
+            if (waited > max_wait) {
+                max_wait = waited;
+                max_wait_id = node->id;
+            }
+
+            pb_debug(2, DBG_EXEC, "%10.3f: Start '%s' (%.3f secs)\n", now, node->name, node->weight_secs);
+        }
+
+        if (!sim.running_num)
+            break;
+
+        id = pb_sched_heap_pop(sim.running, &sim.running_num, pb_sim_running_before, &sim);
+        now = sim.end[id];
+        pg->nodes[id].status = PB_STATUS_DONE;
+        built++;
+
+        pb_debug(2, DBG_EXEC, "%10.3f: Done '%s'\n", now, pg->nodes[id].name);
+
+        for (i = pg->children_off[id]; i < pg->children_off[id + 1]; i++) {
+            PBNode  child = &pg->nodes[pg->children[i]];
+
+            if (--child->pending_parents == 0) {
+                sim.ready_secs[child->id] = now;
+                pb_sched_ready_push(pg, child, (gint64)(now * G_USEC_PER_SEC));
+            }
+        }
+    }
+
+    if (built != pg->nodes_num - 1) {
+        pb_log(PB_ERR, "%s(): Only %u of %u packages could be built\n", __func__, built, pg->nodes_num - 1);
+        ret = PB_FAIL;
+        goto out;
+    }
+
+    pb_log(PB_INFO, "Simulated makespan: %.3f secs\n", now);
+    pb_log(PB_INFO, "Total building time: %.3f secs, max %u packages at the same time\n", work, max_running);
+    pb_log(PB_INFO, "Slot utilization: %.1f%% (%.3f idle slot-secs)\n",
+        now > 0 ? 100.0 * work / (pg->slots * now) : 0.0, pg->slots * now - work);
+
+    pb_sim_print_critical_path(pg);
+    cp_secs = pg->nodes[0].cp_secs;
+    bound = MAX(cp_secs, work / pg->slots);
+    pb_log(PB_INFO, "Lower bound: %.3f secs (%s), the makespan is %.1f%% above it\n", bound,
+        cp_secs >= work / pg->slots ? "critical path" : "total building time / slots",
+        bound > 0 ? MAX(100.0 * (now - bound) / bound, 0.0) : 0.0);
+
+    if (max_wait > 0)
+        pb_log(PB_INFO, "Wait of the ready packages: %.3f secs on average, %.3f secs at most ('%s')\n",
+            wait / built, max_wait, pg->nodes[max_wait_id].name);
+    else
+        pb_log(PB_INFO, "Wait of the ready packages: none, they were all started as soon as they were ready\n");
+
+out:
+    g_free(sim.ready_secs);
+    g_free(sim.end);
+    g_free(sim.running);
+
+    return ret;
+}
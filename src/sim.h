@@ -0,0 +1,35 @@
+/**
+ * @file sim.h
+ * @brief Simulate the build of the graph in virtual time
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include "graph_common.h"
+#include "sched.h"
+#include "graph_create.h"
+#include "utils.h"
+
+#define PB_SIM_HISTORY              "history"
+#define PB_SIM_LOGNORMAL            "lognormal"
+
+/**
+ * Default parameters of the synthetic building times: a log-normal distribution, since most
+ * packages take a few seconds and a few of them take much longer
+ */
+#define PB_SIM_LOGNORMAL_MEDIAN     20.0
+#define PB_SIM_LOGNORMAL_SIGMA      1.2
+
+/**
+ * Seed of the synthetic building times, so the same graph always gets the same times
+ */
+#define PB_SIM_SEED                 1
+
+PBResult    pb_sim_run(PBMain, const gchar *);
+
+#endif  /* _SIM_H_ */
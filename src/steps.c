@@ -0,0 +1,255 @@
+/**
+ * @file steps.c
+ * @brief Split the time required to build each package into the steps of Buildroot's
+ * package infrastructure. Buildroot prints a ">>> <package> <version> <step>" line when a step
+ * starts, so a step lasts from its line until the next one or until make exits. The lines of
+ * the hooks, like "Fixing libtool files", don't start a new step.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "steps.h"
+
+/**
+ * Names of the steps used in the summary and in the history
+ */
+static const gchar *pb_steps_names[PB_STEP_NUM] = {
+    "startup",
+    "download",
+    "extract",
+    "patch",
+    "configure",
+    "build",
+    "staging",
+    "target",
+    "host",
+    "images"
+};
+
+/**
+ * Text of the ">>>" lines that start each step
+ */
+static const struct
+{
+    const gchar     *text;
+    PBStep          step;
+} pb_steps_markers[] = {
+    { "Downloading",                PB_STEP_DOWNLOAD },
+    { "Extracting",                 PB_STEP_EXTRACT },
+    { "Syncing from source dir",    PB_STEP_EXTRACT },
+    { "Patching",                   PB_STEP_PATCH },
+    { "Updating config.sub",        PB_STEP_PATCH },
+    { "Autoreconfiguring",          PB_STEP_CONFIGURE },
+    { "Configuring",                PB_STEP_CONFIGURE },
+    { "Building",                   PB_STEP_BUILD },
+    { "Installing to staging",      PB_STEP_INSTALL_STAGING },
+    { "Installing to target",       PB_STEP_INSTALL_TARGET },
+    { "Installing to host",         PB_STEP_INSTALL_HOST },
+    { "Installing to images",       PB_STEP_INSTALL_IMAGES }
+};
+
+/**
+ * @brief Get the name of a step
+ * @param step The step
+ * @return The name
+ */
+const gchar * pb_steps_get_name(PBStep step)
+{
+    return (step < PB_STEP_NUM) ? pb_steps_names[step] : "unknown";
+}
+
+/**
+ * @brief Get the step started by a ">>>" line
+ * @param line The line
+ * @return The step or -1 if the line doesn't start a step
+ */
+gint pb_steps_from_marker(const gchar *line)
+{
+    guint   i;
+
+    for (i = 0; i < G_N_ELEMENTS(pb_steps_markers); i++)
+        if (strstr(line, pb_steps_markers[i].text))
+            return pb_steps_markers[i].step;
+
+    return -1;
+}
+
+/**
+ * @brief Store in a node the time spent in each step by its make process, that just exited.
+ * The current step ends now.
+ * @param node The node that was built
+ * @param log The log of its make process or NULL if it couldn't be opened
+ */
+void pb_steps_set(PBNode node, PBLog log)
+{
+    if (!log) {
+        memset(node->step_secs, 0, sizeof(node->step_secs));
+        return;
+    }
+
+    memcpy(node->step_secs, log->step_secs, sizeof(node->step_secs));
+    node->step_secs[log->step] += (g_get_monotonic_time() - log->step_usecs) / (gdouble)G_USEC_PER_SEC;
+}
+
+/**
+ * @brief Append the steps that took any time as "<step>=<secs>,..." or "-" if none did
+ * @param secs Time spent in each step
+ * @param str Where it's appended
+ */
+void pb_steps_to_string(const gdouble *secs, GString *str)
+{
+    gsize   len = str->len;
+    guint   i;
+
+    for (i = 0; i < PB_STEP_NUM; i++)
+        if (secs[i] >= 0.001)
+            g_string_append_printf(str, "%s%s=%.3f", (str->len > len) ? "," : "", pb_steps_names[i], secs[i]);
+
+    if (str->len == len)
+        g_string_append_c(str, '-');
+}
+
+/**
+ * @brief Parse the string written by pb_steps_to_string(). Unknown steps are ignored,
+ * so the steps added by newer versions don't invalidate the string.
+ * @param str The string
+ * @param secs Where the time spent in each step is stored
+ * @return PB_OK if successful, PB_FAIL otherwise
+ */
+PBResult pb_steps_from_string(const gchar *str, gdouble *secs)
+{
+    gchar   **items,
+            *end;
+    guint   i,
+            j;
+
+    memset(secs, 0, PB_STEP_NUM * sizeof(gdouble));
+
+    if (!strcmp(str, "-"))
+        return PB_OK;
+
+    items = g_strsplit(str, ",", -1);
+
+    for (i = 0; items[i]; i++) {
+        gchar   *value = strchr(items[i], '=');
+
+        if (!value) {
+            g_strfreev(items);
+            return PB_FAIL;
+        }
+        *value++ = '\0';
+
+        for (j = 0; j < PB_STEP_NUM; j++) {
+            if (strcmp(items[i], pb_steps_names[j]))
+                continue;
+
+            secs[j] = g_ascii_strtod(value, &end);
+            if (end == value || *end != '\0' || secs[j] < 0) {
+                g_strfreev(items);
+                return PB_FAIL;
+            }
+            break;
+        }
+    }
+
+    g_strfreev(items);
+
+    return PB_OK;
+}
+
+static gint pb_steps_cmp_elapsed(gconstpointer a, gconstpointer b)
+{
+    PBNode  node_a = *(PBNode *)a;
+    PBNode  node_b = *(PBNode *)b;
+
+    return (node_a->elapsed_secs < node_b->elapsed_secs) - (node_a->elapsed_secs > node_b->elapsed_secs);
+}
+
+/**
+ * @brief Print the time spent in each step by all the packages built in this run and the package
+ * that spent more time in each one, and write the steps of all the packages to pbuilder_logs/pbuilder_steps.log
+ * @param pg Main struct
+ */
+void pb_steps_print_summary(PBMain pg)
+{
+    PBNode      longest[PB_STEP_NUM] = { NULL };
+    GPtrArray   *built;
+    GString     *table;
+    GError      *error = NULL;
+    gchar       *path;
+    gdouble     total[PB_STEP_NUM] = { 0 },
+                wall_secs = 0;
+    guint       i,
+                j;
+
+    if (!pg)
+        return;
+
+    built = g_ptr_array_new();
+
+    for (i = 1; i < pg->nodes_num; i++) {
+        PBNode  node = &pg->nodes[i];
+
+        /* Only the nodes built in this run have a start time */
+        if (!node->start_usecs || node->status != PB_STATUS_DONE)
+            continue;
+
+        g_ptr_array_add(built, node);
+        wall_secs += node->elapsed_secs;
+
+        for (j = 0; j < PB_STEP_NUM; j++) {
+            total[j] += node->step_secs[j];
+            if (!longest[j] || node->step_secs[j] > longest[j]->step_secs[j])
+                longest[j] = node;
+        }
+    }
+
+    if (!built->len || wall_secs <= 0) {
+        g_ptr_array_free(built, TRUE);
+        return;
+    }
+
+    g_ptr_array_sort(built, pb_steps_cmp_elapsed);
+
+    /* The steps of every package go to a file */
+    table = g_string_new(NULL);
+    g_string_printf(table, "%-32s %9s", "Package", "Wall(s)");
+    for (j = 0; j < PB_STEP_NUM; j++)
+        g_string_append_printf(table, " %9s", pb_steps_names[j]);
+    g_string_append_c(table, '\n');
+
+    for (i = 0; i < built->len; i++) {
+        PBNode  node = g_ptr_array_index(built, i);
+
+        g_string_append_printf(table, "%-32s %9.1f", node->name, node->elapsed_secs);
+        for (j = 0; j < PB_STEP_NUM; j++)
+            g_string_append_printf(table, " %9.1f", node->step_secs[j]);
+        g_string_append_c(table, '\n');
+    }
+
+    path = g_strdup_printf("%s/pbuilder_logs/%s", pg->env->config_dir, PB_STEPS_FILE);
+    if (!g_file_set_contents(path, table->str, table->len, &error)) {
+        pb_log(PB_WARN, "%s(): Failed to write %s: %s\n", __func__, path, error->message);
+        g_error_free(error);
+    }
+    g_free(path);
+
+    /* And the totals to stdout */
+    g_string_printf(table, "%-10s %10s %7s   %s\n", "Step", "Total(s)", "%", "Longest package");
+    for (j = 0; j < PB_STEP_NUM; j++) {
+        if (total[j] < 0.001)
+            continue;
+
+        g_string_append_printf(table, "%-10s %10.1f %6.1f%%   %s (%.1f secs)\n", pb_steps_names[j], total[j],
+            total[j] / wall_secs * 100, longest[j]->name, longest[j]->step_secs[j]);
+    }
+
+    pb_log(PB_INFO, "===== Time spent in each step by the %u packages built (all of them in pbuilder_logs/%s):\n",
+        built->len, PB_STEPS_FILE);
+    printf("%s", table->str);
+
+    g_string_free(table, TRUE);
+    g_ptr_array_free(built, TRUE);
+}
@@ -0,0 +1,29 @@
+/**
+ * @file steps.h
+ * @brief Time spent by each package in each step of its build
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _STEPS_H_
+#define _STEPS_H_
+
+#include "graph_common.h"
+#include "logs.h"
+#include "utils.h"
+
+/**
+ * File inside pbuilder_logs with the time spent by all the packages in each step
+ */
+#define PB_STEPS_FILE               "pbuilder_steps.log"
+
+const gchar *   pb_steps_get_name(PBStep);
+gint        pb_steps_from_marker(const gchar *);
+void        pb_steps_set(PBNode, PBLog);
+void        pb_steps_to_string(const gdouble *, GString *);
+PBResult    pb_steps_from_string(const gchar *, gdouble *);
+void        pb_steps_print_summary(PBMain);
+
+#endif  /* _STEPS_H_ */
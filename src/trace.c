@@ -0,0 +1,227 @@
+/**
+ * @file trace.c
+ * @brief Write the timeline of the build in the Trace Event Format, so it can be opened with
+ * Perfetto or chrome://tracing. Each slot has its own track with a span for each package built
+ * in it, and a separate track shows when the packages become ready. The counters show the number
+ * of running and ready packages and the number of slots. All the timestamps are microseconds
+ * since pg->start_usecs, taken from the same monotonic clock as pg->timer.
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#include "trace.h"
+
+/**
+ * @brief Write a string as a JSON string
+ * @param fd The trace file
+ * @param str The string
+ */
+static void pb_trace_write_str(FILE *fd, const gchar *str)
+{
+    const guchar    *p;
+
+    fputc('"', fd);
+
+    for (p = (const guchar *)str; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            fprintf(fd, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(fd, "\\u%04x", *p);
+        else
+            fputc(*p, fd);
+    }
+
+    fputc('"', fd);
+}
+
+/**
+ * @brief Start a new event: write the separator, the phase, the track and the timestamp.
+ * The caller writes the rest of the fields and closes the event.
+ * @param pg Main struct
+ * @param ph Event phase
+ * @param tid Track of the event
+ * @param usecs Monotonic time of the event
+ * @param name Name of the event
+ */
+static void pb_trace_begin_event(PBMain pg, gchar ph, guint tid, gint64 usecs, const gchar *name)
+{
+    FILE    *fd = pg->trace->fd;
+
+    fprintf(fd, "%s{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%" G_GINT64_FORMAT ",\"name\":",
+        pg->trace->events++ ? ",\n" : "", ph, tid, MAX(usecs - pg->start_usecs, 0));
+    pb_trace_write_str(fd, name);
+}
+
+/**
+ * @brief Name a track and set its position
+ * @param pg Main struct
+ * @param tid The track
+ * @param name The track name
+ */
+static void pb_trace_name_track(PBMain pg, guint tid, const gchar *name)
+{
+    pb_trace_begin_event(pg, 'M', tid, pg->start_usecs, "thread_name");
+    fprintf(pg->trace->fd, ",\"args\":{\"name\":");
+    pb_trace_write_str(pg->trace->fd, name);
+    fprintf(pg->trace->fd, "}}");
+
+    pb_trace_begin_event(pg, 'M', tid, pg->start_usecs, "thread_sort_index");
+    fprintf(pg->trace->fd, ",\"args\":{\"sort_index\":%u}}", tid);
+}
+
+/**
+ * @brief Create the trace file given in the cmdline, if any, and name the process
+ * and the track of the events that don't happen in a slot
+ * @param pg Main struct
+ * @return PB_OK if successful or if there's no trace file, PB_FAIL otherwise
+ */
+PBResult pb_trace_open(PBMain pg)
+{
+    FILE    *fd;
+
+    if (!pg || !trace_file)
+        return PB_OK;
+
+    if ((fd = fopen(trace_file, "w")) == NULL) {
+        pb_log(PB_ERR, "%s(): fopen(): %s: %s\n", __func__, trace_file, strerror(errno));
+        return PB_FAIL;
+    }
+
+    pg->trace = g_new0(struct pbuilder_trace_st, 1);
+    pg->trace->fd = fd;
+
+    fprintf(fd, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    pb_trace_begin_event(pg, 'M', PB_TRACE_SCHED_TID, pg->start_usecs, "process_name");
+    fprintf(fd, ",\"args\":{\"name\":\"%s\"}}", PBUILDER_NAME);
+
+    pb_trace_name_track(pg, PB_TRACE_SCHED_TID, "ready");
+
+    return PB_OK;
+}
+
+/**
+ * @brief A node became ready: all its parents are built
+ * @param pg Main struct
+ * @param node The node
+ */
+void pb_trace_ready(PBMain pg, PBNode node)
+{
+    if (!pg->trace)
+        return;
+
+    pb_trace_begin_event(pg, 'i', PB_TRACE_SCHED_TID, node->ready_usecs, node->name);
+    fprintf(pg->trace->fd, ",\"cat\":\"ready\",\"s\":\"t\",\"args\":{\"priority\":%u}}", node->priority);
+}
+
+/**
+ * @brief A node was dispatched to its slot
+ * @param pg Main struct
+ * @param node The node
+ */
+void pb_trace_start(PBMain pg, PBNode node)
+{
+    gchar   name[32];
+
+    if (!pg->trace)
+        return;
+
+    /* The slots are named as they're used, since adaptive slots are added while building */
+    while (pg->trace->slots_named <= node->slot) {
+        g_snprintf(name, sizeof(name), "slot %u", pg->trace->slots_named + 1);
+        pb_trace_name_track(pg, pg->trace->slots_named + 1 + PB_TRACE_SCHED_TID, name);
+        pg->trace->slots_named++;
+    }
+
+    pb_trace_begin_event(pg, 'i', node->slot + 1 + PB_TRACE_SCHED_TID, node->start_usecs, node->name);
+    fprintf(pg->trace->fd, ",\"cat\":\"dispatch\",\"s\":\"t\",\"args\":{\"wait_ms\":%.3f}}",
+        node->ready_usecs ? (node->start_usecs - node->ready_usecs) / 1000.0 : 0);
+}
+
+/**
+ * @brief A node finished building: write its span in its slot and an instant event if it failed
+ * @param pg Main struct
+ * @param node The node
+ * @param requeued The node was killed by the OOM killer and will be built again
+ */
+void pb_trace_finish(PBMain pg, PBNode node, gboolean requeued)
+{
+    gint64  end_usecs = g_get_monotonic_time();
+    guint   tid = node->slot + 1 + PB_TRACE_SCHED_TID;
+
+    if (!pg->trace)
+        return;
+
+    pb_trace_begin_event(pg, 'X', tid, node->start_usecs, node->name);
+    fprintf(pg->trace->fd, ",\"cat\":\"package\",\"dur\":%" G_GINT64_FORMAT ",\"args\":{\"version\":",
+        end_usecs - node->start_usecs);
+    pb_trace_write_str(pg->trace->fd, node->version);
+    fprintf(pg->trace->fd, ",\"priority\":%u,\"exit_status\":%d,\"cpu_secs\":%.3f,\"maxrss_kb\":%" G_GINT64_FORMAT "}}",
+        node->priority, node->exit_status, node->utime_secs + node->stime_secs, node->maxrss_kb);
+
+    if (requeued || node->build_failed) {
+        pb_trace_begin_event(pg, 'i', tid, end_usecs, node->name);
+        fprintf(pg->trace->fd, ",\"cat\":\"%s\",\"s\":\"g\",\"args\":{\"exit_status\":%d}}",
+            requeued ? "oom-killed" : "failure", node->exit_status);
+    }
+}
+
+/**
+ * @brief Something happened to a node outside of the slots, such as being skipped
+ * @param pg Main struct
+ * @param node The node
+ * @param what Category of the event
+ */
+void pb_trace_instant(PBMain pg, PBNode node, const gchar *what)
+{
+    if (!pg->trace)
+        return;
+
+    pb_trace_begin_event(pg, 'i', PB_TRACE_SCHED_TID, g_get_monotonic_time(), node->name);
+    fprintf(pg->trace->fd, ",\"cat\":");
+    pb_trace_write_str(pg->trace->fd, what);
+    fprintf(pg->trace->fd, ",\"s\":\"t\"}");
+}
+
+/**
+ * @brief Write the number of running and ready nodes and the number of slots if any of them changed
+ * @param pg Main struct
+ */
+void pb_trace_counters(PBMain pg)
+{
+    PBTrace trace = pg->trace;
+
+    if (!trace || (trace->events > 0 && trace->running == pg->nodes_running &&
+            trace->ready == pg->ready_num && trace->slots == pg->slots))
+        return;
+
+    trace->running = pg->nodes_running;
+    trace->ready = pg->ready_num;
+    trace->slots = pg->slots;
+
+    pb_trace_begin_event(pg, 'C', PB_TRACE_SCHED_TID, g_get_monotonic_time(), "packages");
+    fprintf(trace->fd, ",\"args\":{\"running\":%u,\"ready\":%u,\"slots\":%u}}",
+        trace->running, trace->ready, trace->slots);
+}
+
+/**
+ * @brief Terminate and close the trace file
+ * @param pg Main struct
+ */
+void pb_trace_close(PBMain pg)
+{
+    if (!pg || !pg->trace)
+        return;
+
+    fprintf(pg->trace->fd, "\n]}\n");
+
+    if (fclose(pg->trace->fd) != 0)
+        pb_log(PB_WARN, "%s(): fclose(): %s: %s\n", __func__, trace_file, strerror(errno));
+    else
+        pb_log(PB_INFO, "===== Build timeline written to %s\n", trace_file);
+
+    g_free(pg->trace);
+    pg->trace = NULL;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file trace.h
+ * @brief Timeline of the build in the Trace Event Format used by Perfetto and chrome://tracing
+ *
+ * Copyright (C) 2025 Pedro Aguilar <paguilar@paguilar.org>
+ * Released under the terms of the GNU GPL v2.0.
+ *
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "graph_common.h"
+#include "utils.h"
+
+/**
+ * Track of the events that don't happen in a slot. The track of slot n is n + 1
+ */
+#define PB_TRACE_SCHED_TID          0
+
+typedef struct pbuilder_trace_st *  PBTrace;
+
+/**
+ * The trace file being written
+ */
+struct pbuilder_trace_st
+{
+    FILE            *fd;                /**< Trace file */
+    guint           events;             /**< Number of events written */
+    guint           slots_named;        /**< Number of slot tracks already named */
+    guint           running;            /**< Last value written of the running counter */
+    guint           ready;              /**< Last value written of the ready counter */
+    guint           slots;              /**< Last value written of the slots counter */
+};
+
+PBResult    pb_trace_open(PBMain);
+void        pb_trace_ready(PBMain, PBNode);
+void        pb_trace_start(PBMain, PBNode);
+void        pb_trace_finish(PBMain, PBNode, gboolean);
+void        pb_trace_instant(PBMain, PBNode, const gchar *);
+void        pb_trace_counters(PBMain);
+void        pb_trace_close(PBMain);
+
+#endif  /* _TRACE_H_ */
@@ -16,6 +16,8 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
 #include <string.h>
 #include <errno.h>
 
@@ -30,12 +32,25 @@
  * GCC 10 defaults to -fno-common, which means a linker error is reported if
  * extern is ommited when declaring global variables in a header file that is
  * included by several files. To fix this, use extern in header files and ensure
- * each global is defined in exactly one C file.
+ * each global is defined in exactly one C file, globals.c.
  */
 extern gint    debug_level;        /**< Set debug level. Values: [0-3]. Default: 0 */
 extern gchar   *debug_module;      /**< Set module to debug. Values: [all]. Default: all */
 extern gchar   *deps_file;         /**< Filename given in the cmdline */
+extern gchar   *show_info;         /**< Output of 'make show-info' given in the cmdline */
+extern gboolean split_steps;       /**< Each package is split into a node for each of its steps */
 extern gint    cpu_num;            /**< Max number of CPU used to build */
+extern gchar   *schedule;          /**< Scheduling policy given in the cmdline */
+extern gint    jobs;               /**< Total number of jobs shared through the jobserver */
+extern gchar   *adaptive;          /**< Range of slots of the adaptive concurrency controller */
+extern gint    mem_budget;         /**< Memory in MB that the running packages are expected to use at most */
+extern gint    prefetch;           /**< Number of packages whose sources are downloaded at the same time ahead of the build */
+extern gboolean prefetch_extract;  /**< The prefetched sources are extracted too */
+extern gchar   *log_compress;      /**< Compressor of the logs */
+extern gint    log_tail;           /**< Number of lines printed when a package fails */
+extern gchar   *trace_file;        /**< File where the timeline of the build is written */
+extern gboolean keep_going;        /**< Build all the packages that don't depend on a failed one */
+extern gchar   *simulate;          /**< Building times of the simulated build instead of building */
 
 #define PBUILDER_NAME   "pbuilder"
 #define PBUILDER_DESC   "Top-level parallel building utility for Buildroot that uses an acyclic graph"